@@ -0,0 +1,90 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "utils.h"
+
+/*
+ * Add a block able to hold at least `len` bytes to `arena`.
+ *
+ * Big requests get a block of their own, placed after the current
+ * block, so that what's left in the current one can still be used.
+ *
+ * Returns the new block.
+ */
+static arena_block_t *
+add_block (arena_t *arena, size_t len)
+{
+  size_t size = len > ARENA_BLOCK_SIZE / 4 ? len : ARENA_BLOCK_SIZE;
+  arena_block_t *block = xalloc (sizeof (*block) + size);
+  block->size = size;
+
+  if (size == len && arena->blocks)
+    {
+      block->next = arena->blocks->next;
+      arena->blocks->next = block;
+    }
+  else
+    {
+      block->next = arena->blocks;
+      arena->blocks = block;
+    }
+
+  return block;
+}
+
+/*
+ * Copy the `len` first bytes of `string` in `arena`, NUL terminated.
+ *
+ * The copy lives until `free_arena()` is called, it can't be freed on
+ * its own.
+ */
+char *
+arena_strndup (arena_t *arena, const char *string, size_t len)
+{
+  arena_block_t *block = arena->blocks;
+  if (!block || block->size - block->used < len + 1)
+    block = add_block (arena, len + 1);
+
+  char *copy = block->data + block->used;
+  memcpy (copy, string, len);
+  copy[len] = 0;
+  block->used += len + 1;
+
+  return copy;
+}
+
+/*
+ * Move all memory of `other` into `arena`, so it's freed with it.
+ */
+void
+arena_merge (arena_t *arena, arena_t *other)
+{
+  if (!other->blocks)
+    return;
+
+  arena_block_t *last = other->blocks;
+  while (last->next)
+    last = last->next;
+
+  last->next = arena->blocks;
+  arena->blocks = other->blocks;
+  other->blocks = NULL;
+}
+
+/*
+ * Free all memory held by `arena`.
+ */
+void
+free_arena (arena_t *arena)
+{
+  arena_block_t *block = arena->blocks;
+  while (block)
+    {
+      arena_block_t *next = block->next;
+      free (block);
+      block = next;
+    }
+
+  arena->blocks = NULL;
+}
@@ -0,0 +1,23 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE (1024 * 1024)
+
+typedef struct arena_block_t {
+  struct arena_block_t *next;
+  size_t size;
+  size_t used;
+  char data[];
+} arena_block_t;
+
+typedef struct {
+  arena_block_t *blocks;
+} arena_t;
+
+char *arena_strndup (arena_t *arena, const char *string, size_t len);
+void arena_merge (arena_t *arena, arena_t *other);
+void free_arena (arena_t *arena);
+
+#endif
@@ -0,0 +1,57 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "arena.h"
+#include "data.h"
+#include "source.h"
+#include "reflow.h"
+#include "batch.h"
+
+#define SEPARATOR "--------"
+
+/*
+ * Write formatted vulnerabilities to `output`, without ncurses, in
+ * `order` if it's not NULL.
+ *
+ * Each vulnerability is reflowed to `max_width` and written before
+ * moving to the next, reusing the same lines, so memory usage does not
+ * depend on how many there are.
+ *
+ * Returns non-zero in case of error.
+ */
+int
+print_vulnerabilities (vulnerability_list_t *vulnerabilities, const size_t *order, size_t max_width, FILE *output)
+{
+  static char buffer[65536];
+  setvbuf (output, buffer, _IOFBF, sizeof (buffer));
+
+  line_list_t lines = {0};
+
+  for (size_t i = 0; i < vulnerabilities->count; i++)
+    {
+      clear_lines (&lines);
+      reflow (max_width, &vulnerabilities->items[order ? order[i] : i], &lines);
+
+      if (i > 0)
+        fputs (SEPARATOR "\n", output);
+
+      for (size_t j = 0; j < lines.count; j++)
+        {
+          fwrite (lines.text + lines.items[j].offset, 1, lines.items[j].length, output);
+          fputc ('\n', output);
+        }
+
+      fputc ('\n', output);
+    }
+
+  free_lines (&lines);
+
+  if (fflush (output) || ferror (output))
+    {
+      fprintf (stderr, "batch.c : print_vulnerabilities() : can't write output.\n");
+      return 1;
+    }
+
+  return 0;
+}
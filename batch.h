@@ -0,0 +1,6 @@
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+int print_vulnerabilities (vulnerability_list_t *vulnerabilities, const size_t *order, size_t max_width, FILE *output);
+
+#endif
@@ -0,0 +1,271 @@
+#include <getopt.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "data.h"
+#include "source.h"
+#include "reflow.h"
+#include "snapshot.h"
+#include "utils.h"
+
+#define MAX_SAMPLES 1000
+
+static const size_t widths[] = { 40, 80, 120, 200 };
+
+typedef struct {
+  double *values;
+  size_t count;
+  size_t capacity;
+} samples_t;
+
+static void
+usage (const char *progname)
+{
+  printf ("%s [-h|--help] [-n iterations] [-s source_dir] <file>... \n\
+\n\
+Benchmarks parsing, formatting and freeing of each report. \n\
+\n\
+Results are printed as one json object per line, with throughput \n\
+and latency percentiles in microseconds. \n\
+\n\
+  -n    how many times to parse each report (default: 5) \n\
+  -s    directory containing the sources referenced by reports, \n\
+        to benchmark snippets (see generate -s) \n\
+  ", progname);
+}
+
+static double
+now ()
+{
+  struct timespec time;
+  clock_gettime (CLOCK_MONOTONIC, &time);
+  return time.tv_sec * 1e6 + time.tv_nsec / 1e3;
+}
+
+static void
+add_sample (samples_t *samples, double value)
+{
+  samples->values = xgrow (samples->values, sizeof (double), samples->count + 1, &samples->capacity);
+  samples->values[samples->count++] = value;
+}
+
+static int
+compare_samples (const void *a, const void *b)
+{
+  double x = *(const double *) a;
+  double y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+static double
+percentile (samples_t *samples, double rank)
+{
+  size_t i = (size_t) (rank * (samples->count - 1) + 0.5);
+  return samples->values[i];
+}
+
+/*
+ * Print results for `samples` as a json line, then reset them.
+ *
+ * `items` is how many things (vulnerabilities, lines, bytes) were
+ * processed by each sample, to compute throughput.
+ */
+static void
+report (const char *file, const char *stage, size_t width, samples_t *samples, double items, const char *unit)
+{
+  if (samples->count == 0)
+    return;
+
+  double total = 0;
+  for (size_t i = 0; i < samples->count; i++)
+    total += samples->values[i];
+
+  qsort (samples->values, samples->count, sizeof (double), compare_samples);
+
+  printf ("{\"file\":\"%s\",\"stage\":\"%s\",\"width\":%zu,\"samples\":%zu,\"throughput\":%.1f,\"unit\":\"%s/s\",\"p50_us\":%.2f,\"p90_us\":%.2f,\"p99_us\":%.2f,\"max_us\":%.2f}\n",
+          file, stage, width, samples->count, total > 0 ? items * samples->count / (total / 1e6) : 0, unit,
+          percentile (samples, 0.5), percentile (samples, 0.9), percentile (samples, 0.99), samples->values[samples->count - 1]);
+  fflush (stdout);
+
+  samples->count = 0;
+}
+
+/*
+ * Reflow a sample of vulnerabilities at each width.
+ */
+static void
+bench_reflow (const char *file, vulnerability_list_t *vulnerabilities, const char *stage, bool cold)
+{
+  samples_t samples = {0};
+  size_t step = vulnerabilities->count / MAX_SAMPLES + 1;
+
+  for (size_t w = 0; w < sizeof (widths) / sizeof (widths[0]); w++)
+    {
+      size_t lines_count = 0;
+      for (size_t i = 0; i < vulnerabilities->count; i += step)
+        {
+          line_list_t lines = {0};
+          if (cold)
+            free_sources ();
+
+          double start = now ();
+          reflow (widths[w], &vulnerabilities->items[i], &lines);
+          add_sample (&samples, now () - start);
+
+          lines_count += lines.count;
+          free_lines (&lines);
+        }
+
+      report (file, stage, widths[w], &samples, samples.count ? (double) lines_count / samples.count : 0, "lines");
+    }
+
+  if (samples.values) free (samples.values);
+}
+
+/*
+ * Measure how long reopening report at `file` takes once it has a
+ * snapshot, checking it's still current included.
+ */
+static void
+bench_snapshot (const char *file, vulnerability_list_t *vulnerabilities, size_t iterations, size_t size)
+{
+  samples_t samples = {0};
+  snapshot_key_t key;
+
+  if (get_snapshot_key (file, &key))
+    return;
+
+  save_snapshot (file, &key, vulnerabilities);
+
+  for (size_t i = 0; i < iterations; i++)
+    {
+      vulnerability_list_t snapshot = {0};
+      double start = now ();
+      int err = get_snapshot_key (file, &key) || load_snapshot (file, &key, &snapshot);
+      add_sample (&samples, now () - start);
+      free_data (&snapshot);
+
+      if (err)
+        {
+          fprintf (stderr, "bench.c : bench_snapshot() : can't load snapshot of %s\n", file);
+          break;
+        }
+    }
+
+  report (file, "load_snapshot", 0, &samples, size, "bytes");
+  if (samples.values) free (samples.values);
+}
+
+/*
+ * Run all benchmarks on report at `file`.
+ *
+ * Returns non-zero in case of error.
+ */
+static int
+bench_file (const char *file, size_t iterations, const char *source_dir, const char *initial_dir)
+{
+  samples_t parse_samples = {0};
+  samples_t free_samples = {0};
+  vulnerability_list_t vulnerabilities = {0};
+  size_t count = 0;
+
+  struct stat info;
+  if (stat (file, &info))
+    {
+      fprintf (stderr, "bench.c : bench_file() : can't stat %s\n", file);
+      return 1;
+    }
+
+  for (size_t i = 0; i < iterations; i++)
+    {
+      double start = now ();
+      int err = parse_data (file, &vulnerabilities);
+      add_sample (&parse_samples, now () - start);
+      if (err)
+        {
+          fprintf (stderr, "bench.c : bench_file() : can't parse %s\n", file);
+          free_data (&vulnerabilities);
+          return 1;
+        }
+
+      count = vulnerabilities.count;
+      if (i + 1 == iterations)
+        break;
+
+      start = now ();
+      free_data (&vulnerabilities);
+      add_sample (&free_samples, now () - start);
+    }
+
+  report (file, "parse_data", 0, &parse_samples, info.st_size, "bytes");
+
+  bench_snapshot (file, &vulnerabilities, iterations, info.st_size);
+
+  bench_reflow (file, &vulnerabilities, "reflow", false);
+
+  if (source_dir && chdir (source_dir) == 0)
+    {
+      if (set_source_root (NULL))
+        fprintf (stderr, "bench.c : bench_file() : can't resolve %s\n", source_dir);
+
+      bench_reflow (file, &vulnerabilities, "reflow_snippet_cold", true);
+      bench_reflow (file, &vulnerabilities, "reflow_snippet_warm", false);
+      free_sources ();
+      free_source_root ();
+      if (chdir (initial_dir))
+        fprintf (stderr, "bench.c : bench_file() : can't go back to %s\n", initial_dir);
+    }
+
+  double start = now ();
+  free_data (&vulnerabilities);
+  add_sample (&free_samples, now () - start);
+  report (file, "free_data", 0, &free_samples, count, "vulnerabilities");
+
+  if (parse_samples.values) free (parse_samples.values);
+  if (free_samples.values) free (free_samples.values);
+  return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  int err = 0;
+  size_t iterations = 5;
+  const char *source_dir = NULL;
+  char initial_dir[PATH_MAX + 1] = {0};
+
+  struct option options[] = {
+    { "help", no_argument, NULL, 'h' },
+    { 0 },
+  };
+
+  int opt = 0;
+  while ((opt = getopt_long (argc, argv, "hn:s:", options, NULL)) != -1)
+    {
+      switch (opt)
+        {
+          case 'n': iterations = strtoul (optarg, NULL, 10); break;
+          case 's': source_dir = optarg; break;
+          case 'h': usage (argv[0]); return 0;
+          default: usage (argv[0]); return 1;
+        }
+    }
+
+  if (optind == argc || iterations == 0 || !getcwd (initial_dir, PATH_MAX))
+    {
+      usage (argv[0]);
+      return 1;
+    }
+
+  for (int i = optind; i < argc; i++)
+    err |= bench_file (argv[i], iterations, source_dir, initial_dir);
+
+  return err;
+}
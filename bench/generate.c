@@ -0,0 +1,176 @@
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define SOURCE_FILES 16
+#define SOURCE_LINES 20000
+
+static const char *words[] = {
+  "buffer", "overflow", "input", "user", "controlled", "value", "passed",
+  "to", "the", "function", "without", "validation", "may", "allow", "an",
+  "attacker", "execute", "arbitrary", "code", "memory", "copy", "length",
+  "should", "be", "checked", "before", "use", "of", "this", "call",
+};
+
+static void
+usage (const char *progname)
+{
+  printf ("%s [-h|--help] [-a semgrep|flawfinder] [-n count] [-d description_size] [-s source_dir] <file> \n\
+\n\
+Generates a synthetic Gitlab's SAST report in <file>, for benchmarks. \n\
+\n\
+  -a    analyzer whose format to use (default: semgrep) \n\
+  -n    number of vulnerabilities (default: 100) \n\
+  -d    approximate size of each description, in bytes (default: 200) \n\
+  -s    also generate the source files referenced by the report \n\
+        in this directory, so snippets can be benchmarked \n\
+  ", progname);
+}
+
+/*
+ * Write a json string made of random words, with paragraphs and
+ * code blocks, of about `size` bytes.
+ */
+static void
+write_description (FILE *out, size_t size)
+{
+  size_t written = 0;
+  size_t words_count = sizeof (words) / sizeof (words[0]);
+
+  fputc ('"', out);
+  while (written < size)
+    {
+      int roll = rand () % 100;
+      if (roll < 2)
+        written += fprintf (out, "\\n\\n```\\nmemcpy (dest, src, len);\\n```\\n\\n");
+      else if (roll < 5)
+        written += fprintf (out, "\\n\\n");
+      else if (roll < 8)
+        written += fprintf (out, "\\n");
+      else if (roll < 9)
+        written += fprintf (out, " \\u00e9t\\u00e9 ");
+      else
+        written += fprintf (out, "%s ", words[rand () % words_count]);
+    }
+
+  fputc ('"', out);
+}
+
+static void
+write_semgrep (FILE *out, size_t i, size_t description_size)
+{
+  fprintf (out, "{\"id\":\"%08zx\",\"category\":\"sast\",\"name\":\"rule-%zu\",\"title\":\"Rule %zu: improper input handling\",\"description\":", i, i % 97, i % 97);
+  write_description (out, description_size);
+  fprintf (out, ",\"severity\":\"%s\",\"scanner\":{\"id\":\"semgrep\",\"name\":\"Semgrep\"},\"location\":{\"file\":\"src/file%zu.c\",\"start_line\":%d,\"end_line\":%d},\"identifiers\":[{\"type\":\"semgrep_id\",\"name\":\"rule-%zu\",\"value\":\"rule-%zu\"}]}",
+           i % 3 == 0 ? "High" : "Medium", i % SOURCE_FILES, rand () % SOURCE_LINES + 1, SOURCE_LINES, i % 97, i % 97);
+}
+
+static void
+write_flawfinder (FILE *out, size_t i, size_t description_size)
+{
+  fprintf (out, "{\"id\":\"%08zx\",\"category\":\"sast\",\"cve\":\"src/file%zu.c:%08zx:CWE-120\",\"message\":", i, i % SOURCE_FILES, i);
+  write_description (out, description_size);
+  fprintf (out, ",\"solution\":\"Make sure destination can always hold the source data.\",\"severity\":\"High\",\"scanner\":{\"id\":\"flawfinder\",\"name\":\"Flawfinder\"},\"location\":{\"file\":\"src/file%zu.c\",\"start_line\":%d},\"identifiers\":[{\"type\":\"flawfinder_func_name\",\"value\":\"memcpy\"}]}",
+           i % SOURCE_FILES, rand () % SOURCE_LINES + 1);
+}
+
+/*
+ * Write the C-looking source files referenced by reports.
+ *
+ * Returns non-zero in case of error.
+ */
+static int
+write_sources (const char *dir)
+{
+  char path[4096] = {0};
+  snprintf (path, sizeof (path) - 1, "%s/src", dir);
+  if (mkdir (dir, 0755) && errno != EEXIST)
+    return 1;
+
+  if (mkdir (path, 0755) && errno != EEXIST)
+    return 1;
+
+  for (size_t i = 0; i < SOURCE_FILES; i++)
+    {
+      snprintf (path, sizeof (path) - 1, "%s/src/file%zu.c", dir, i);
+      FILE *out = fopen (path, "w");
+      if (!out)
+        return 1;
+
+      for (size_t line = 1; line <= SOURCE_LINES; line++)
+        fprintf (out, "  memcpy (buffer_%zu, input + %zu, length); // line %zu\n", line % 13, line, line);
+
+      fclose (out);
+    }
+
+  return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  const char *analyzer = "semgrep";
+  const char *source_dir = NULL;
+  size_t count = 100;
+  size_t description_size = 200;
+
+  struct option options[] = {
+    { "help", no_argument, NULL, 'h' },
+    { 0 },
+  };
+
+  int opt = 0;
+  while ((opt = getopt_long (argc, argv, "ha:n:d:s:", options, NULL)) != -1)
+    {
+      switch (opt)
+        {
+          case 'a': analyzer = optarg; break;
+          case 'n': count = strtoul (optarg, NULL, 10); break;
+          case 'd': description_size = strtoul (optarg, NULL, 10); break;
+          case 's': source_dir = optarg; break;
+          case 'h': usage (argv[0]); return 0;
+          default: usage (argv[0]); return 1;
+        }
+    }
+
+  bool flawfinder = strcmp (analyzer, "flawfinder") == 0;
+  if (optind != argc - 1 || (!flawfinder && strcmp (analyzer, "semgrep") != 0))
+    {
+      usage (argv[0]);
+      return 1;
+    }
+
+  if (source_dir && write_sources (source_dir))
+    {
+      fprintf (stderr, "generate.c : main() : can't write sources in %s\n", source_dir);
+      return 1;
+    }
+
+  FILE *out = fopen (argv[optind], "w");
+  if (!out)
+    {
+      fprintf (stderr, "generate.c : main() : can't open %s\n", argv[optind]);
+      return 1;
+    }
+
+  srand (count);
+  fprintf (out, "{\"version\":\"15.0.4\",\"vulnerabilities\":[\n");
+  for (size_t i = 0; i < count; i++)
+    {
+      if (flawfinder)
+        write_flawfinder (out, i, description_size);
+      else
+        write_semgrep (out, i, description_size);
+
+      fprintf (out, i + 1 < count ? ",\n" : "\n");
+    }
+
+  fprintf (out, "],\"dependency_files\":[],\"scan\":{\"analyzer\":{\"id\":\"%s\",\"name\":\"%s\",\"version\":\"1.0.0\"},\"type\":\"sast\",\"status\":\"success\"}}\n", analyzer, analyzer);
+  fclose (out);
+
+  return 0;
+}
@@ -1,198 +1,671 @@
-#include <json.h>
-#include <json_pointer.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <string.h>
+#include <strings.h>
 
+#include "arena.h"
 #include "data.h"
+#include "decoder.h"
+#include "stats.h"
+#include "stream.h"
+#include "utils.h"
+
+#define PARALLEL_THRESHOLD (4 * 1024 * 1024)
+#define MIN_VULNERABILITIES_PER_THREAD 1000
+#define MAX_THREADS 16
+
+enum {
+  FIELD_CATEGORY,
+  FIELD_TITLE,
+  FIELD_NAME,
+  FIELD_CVE,
+  FIELD_DESCRIPTION,
+  FIELD_MESSAGE,
+  FIELD_SOLUTION,
+  FIELD_FILE,
+  FIELD_START_LINE,
+  FIELD_SEVERITY,
+  FIELD_CONFIDENCE,
+  FIELD_COUNT,
+};
 
 enum {
-  ANALYZER_SEMGREP,
-  ANALYZER_FLAWFINDER,
+  FIELD_MISSING,
+  FIELD_INVALID,
+  FIELD_PRESENT,
 };
 
-int analyzer_format = 0;
+/*
+ * Problems `check_vulnerability()` can find, besides a field being
+ * invalid, in which case the field itself is returned.
+ */
+enum {
+  PROBLEM_NONE = FIELD_COUNT,
+  PROBLEM_NOT_OBJECT,
+  PROBLEM_LOCATION,
+};
+
+/*
+ * Keys we extract from each vulnerability. Everything else is skipped
+ * without being kept in memory.
+ */
+static const struct {
+  const char *key;
+  bool in_location;
+} fields[FIELD_COUNT] = {
+  [FIELD_CATEGORY]    = { "category",    false },
+  [FIELD_TITLE]       = { "title",       false },
+  [FIELD_NAME]        = { "name",        false },
+  [FIELD_CVE]         = { "cve",         false },
+  [FIELD_DESCRIPTION] = { "description", false },
+  [FIELD_MESSAGE]     = { "message",     false },
+  [FIELD_SOLUTION]    = { "solution",    false },
+  [FIELD_FILE]        = { "file",        true },
+  [FIELD_START_LINE]  = { "start_line",  true },
+  [FIELD_SEVERITY]    = { "severity",    false },
+  [FIELD_CONFIDENCE]  = { "confidence",  false },
+};
+
+/*
+ * Slots of `vulnerability_t` filled from fields. Slots before
+ * SLOT_LINE are strings, slots after it are levels.
+ */
+enum {
+  SLOT_CATEGORY,
+  SLOT_TITLE,
+  SLOT_DESCRIPTION,
+  SLOT_SOLUTION,
+  SLOT_FILE,
+  SLOT_LINE,
+  SLOT_SEVERITY,
+  SLOT_CONFIDENCE,
+  SLOT_COUNT,
+};
+
+#define MAX_CANDIDATES 3
+#define CANDIDATES(...) { __VA_ARGS__, FIELD_COUNT }
+#define NO_CANDIDATES { FIELD_COUNT }
+
+/*
+ * Where a slot comes from: the first of `candidates` which is present
+ * in the vulnerability. When none is, the vulnerability is rejected,
+ * unless the slot is `optional`, in which case it's set to `fallback`,
+ * which may be NULL.
+ */
+typedef struct {
+  int candidates[MAX_CANDIDATES + 1];
+  bool optional;
+  const char *fallback;
+} slot_schema_t;
 
 /*
- * Makes sure the provided semgrep data is formatted as expected.
+ * How vulnerabilities of an analyzer map to `vulnerability_t`. Slots
+ * are checked in order, so the first problem found is the one reported.
+ */
+typedef struct {
+  const char *analyzer;
+  slot_schema_t slots[SLOT_COUNT];
+} schema_t;
+
+/*
+ * Layout of Gitlab's security report format, used by most analyzers.
+ */
+#define GITLAB_SLOTS { \
+  [SLOT_CATEGORY]    = { CANDIDATES (FIELD_CATEGORY) }, \
+  [SLOT_TITLE]       = { CANDIDATES (FIELD_NAME, FIELD_MESSAGE, FIELD_CVE) }, \
+  [SLOT_DESCRIPTION] = { CANDIDATES (FIELD_DESCRIPTION, FIELD_MESSAGE), true, NULL }, \
+  [SLOT_SOLUTION]    = { CANDIDATES (FIELD_SOLUTION), true, NULL }, \
+  [SLOT_FILE]        = { CANDIDATES (FIELD_FILE) }, \
+  [SLOT_LINE]        = { CANDIDATES (FIELD_START_LINE) }, \
+  [SLOT_SEVERITY]    = { CANDIDATES (FIELD_SEVERITY), true, NULL }, \
+  [SLOT_CONFIDENCE]  = { CANDIDATES (FIELD_CONFIDENCE), true, NULL }, \
+}
+
+/*
+ * Supported analyzers, by `/scan/analyzer/id`.
+ *
+ * Flawfinder's message and solution are kept apart, they're only put
+ * together when displayed.
+ */
+static const schema_t schemas[] = {
+  { "semgrep", {
+    [SLOT_CATEGORY]    = { CANDIDATES (FIELD_CATEGORY) },
+    [SLOT_TITLE]       = { CANDIDATES (FIELD_TITLE) },
+    [SLOT_DESCRIPTION] = { CANDIDATES (FIELD_DESCRIPTION) },
+    [SLOT_SOLUTION]    = { NO_CANDIDATES, true, NULL },
+    [SLOT_FILE]        = { CANDIDATES (FIELD_FILE) },
+    [SLOT_LINE]        = { CANDIDATES (FIELD_START_LINE) },
+    [SLOT_SEVERITY]    = { CANDIDATES (FIELD_SEVERITY), true, NULL },
+    [SLOT_CONFIDENCE]  = { CANDIDATES (FIELD_CONFIDENCE), true, NULL },
+  } },
+  { "flawfinder", {
+    [SLOT_CATEGORY]    = { CANDIDATES (FIELD_CATEGORY) },
+    [SLOT_TITLE]       = { CANDIDATES (FIELD_CVE) },
+    [SLOT_DESCRIPTION] = { CANDIDATES (FIELD_MESSAGE) },
+    [SLOT_SOLUTION]    = { CANDIDATES (FIELD_SOLUTION), true, "?" },
+    [SLOT_FILE]        = { CANDIDATES (FIELD_FILE) },
+    [SLOT_LINE]        = { CANDIDATES (FIELD_START_LINE) },
+    [SLOT_SEVERITY]    = { CANDIDATES (FIELD_SEVERITY), true, NULL },
+    [SLOT_CONFIDENCE]  = { CANDIDATES (FIELD_CONFIDENCE), true, NULL },
+  } },
+  { "gosec", GITLAB_SLOTS },
+  { "bandit", GITLAB_SLOTS },
+  { "spotbugs", GITLAB_SLOTS },
+  { "nodejs-scan", GITLAB_SLOTS },
+};
+
+#define SCHEMAS_COUNT (sizeof (schemas) / sizeof (*schemas))
+
+static const char *severity_names[SEVERITIES_COUNT] = {
+  [SEVERITY_UNKNOWN]  = "Unknown",
+  [SEVERITY_INFO]     = "Info",
+  [SEVERITY_LOW]      = "Low",
+  [SEVERITY_MEDIUM]   = "Medium",
+  [SEVERITY_HIGH]     = "High",
+  [SEVERITY_CRITICAL] = "Critical",
+};
+
+static const char *confidence_names[CONFIDENCES_COUNT] = {
+  [CONFIDENCE_UNKNOWN]      = "Unknown",
+  [CONFIDENCE_IGNORE]       = "Ignore",
+  [CONFIDENCE_EXPERIMENTAL] = "Experimental",
+  [CONFIDENCE_LOW]          = "Low",
+  [CONFIDENCE_MEDIUM]       = "Medium",
+  [CONFIDENCE_HIGH]         = "High",
+  [CONFIDENCE_CONFIRMED]    = "Confirmed",
+};
+
+#define FIELDS_TABLE_SIZE 32
+
+/*
+ * Computed once from `fields` and `schemas`: a hash table of field
+ * keys, so that finding which field a key is about takes a single
+ * lookup, and which fields each schema uses.
+ *
+ * Table slots hold field index + 1, so that 0 means empty.
+ */
+static uint64_t field_hashes[FIELD_COUNT];
+static int fields_table[FIELDS_TABLE_SIZE];
+static unsigned int used_fields[SCHEMAS_COUNT];
+static pthread_once_t schemas_prepared = PTHREAD_ONCE_INIT;
+
+/*
+ * A vulnerability as found in the report.
+ *
+ * We can't build `vulnerability_t` right away, because the analyzer
+ * information usually comes after the vulnerabilities in the file.
+ * When its `schema` is already known, fields it does not use are
+ * skipped.
+ *
+ * Strings are copied in `arena`, they're moved to the vulnerability
+ * without being copied again.
+ */
+typedef struct {
+  bool is_object;
+  int location_state;
+  int states[FIELD_COUNT];
+  char *strings[FIELD_COUNT];
+  long long line;
+  arena_t *arena;
+  const schema_t *schema;
+} raw_vulnerability_t;
+
+/*
+ * What we know about the report once it has been streamed.
+ */
+typedef struct {
+  bool is_object;
+  bool has_version;
+  bool has_vulnerabilities;
+  bool vulnerabilities_is_array;
+  int analyzer_state;
+  char *analyzer;
+  const schema_t *schema;
+  raw_vulnerability_t *raws;
+  size_t raws_count;
+  size_t raws_capacity;
+  arena_t arena;
+  bool offsets_only;
+  size_t *offsets;
+  size_t offsets_count;
+  size_t offsets_capacity;
+} report_t;
+
+/*
+ * A range of vulnerabilities to extract on a worker thread.
+ */
+typedef struct {
+  const schema_t *schema;
+  const char *data;
+  size_t size;
+  const size_t *offsets;
+  size_t from;
+  size_t to;
+  vulnerability_t *items;
+  arena_t arena;
+  size_t failed_index;
+  int problem;
+  int err;
+} extract_job_t;
+
+/*
+ * Fill `fields_table` and `used_fields`. This runs once, whatever the
+ * number of reports parsed, and from how many threads.
+ */
+static void
+prepare_schemas ()
+{
+  for (int i = 0; i < FIELD_COUNT; i++)
+    {
+      field_hashes[i] = hash_bytes (fields[i].key, strlen (fields[i].key));
+      size_t slot = field_hashes[i] & (FIELDS_TABLE_SIZE - 1);
+      while (fields_table[slot])
+        slot = (slot + 1) & (FIELDS_TABLE_SIZE - 1);
+
+      fields_table[slot] = i + 1;
+    }
+
+  for (size_t i = 0; i < SCHEMAS_COUNT; i++)
+    for (int slot = 0; slot < SLOT_COUNT; slot++)
+      for (const int *field = schemas[i].slots[slot].candidates; *field != FIELD_COUNT; field++)
+        used_fields[i] |= 1u << *field;
+}
+
+/*
+ * Read the value of `field`, flagging it as invalid if it does not have
+ * the expected type.
  *
  * Returns non-zero in case of error.
  */
 static int
-validate_semgrep_json (const json_object *vulns)
+read_field (stream_t *stream, raw_vulnerability_t *raw, int field)
 {
-  size_t array_len = json_object_array_length (vulns);
-  if (array_len > MAX_VULNERABILITY_COUNT)
-    array_len = MAX_VULNERABILITY_COUNT;
+  int type = stream_peek_type (stream);
 
-  for (size_t i = 0; i < array_len; i++)
+  if (field == FIELD_START_LINE)
     {
-      json_object *vuln = json_object_array_get_idx (vulns, i);
-      if (json_object_get_type (vuln) != json_type_object)
+      if (type != STREAM_NUMBER)
         {
-          fprintf (stderr, "data.c : validate_semgrep_json() : malformed json : vulnerability %ld is not an object.\n", i);
-          return 1;
+          raw->states[field] = FIELD_INVALID;
+          return stream_skip_value (stream);
         }
 
-      json_object *category = json_object_object_get (vuln, "category");
-      if (!category || json_object_get_type (category) != json_type_string)
-        {
-          fprintf (stderr, "data.c : validate_semgrep_json() : malformed json : key `category` in vulnerability %ld either missing or not a string.\n", i);
-          return 1;
-        }
+      bool is_integer = false;
+      int err = stream_read_integer (stream, &raw->line, &is_integer);
+      raw->states[field] = is_integer ? FIELD_PRESENT : FIELD_INVALID;
+      return err;
+    }
 
-      json_object *title = json_object_object_get (vuln, "title");
-      if (!title || json_object_get_type (title) != json_type_string)
-        {
-          fprintf (stderr, "data.c : validate_semgrep_json() : malformed json : key `title` in vulnerability %ld either missing or not a string.\n", i);
-          return 1;
-        }
+  if (type != STREAM_STRING)
+    {
+      raw->states[field] = FIELD_INVALID;
+      return stream_skip_value (stream);
+    }
 
-      json_object *description = json_object_object_get (vuln, "description");
-      if (!description || json_object_get_type (description) != json_type_string)
-        {
-          fprintf (stderr, "data.c : validate_semgrep_json() : malformed json : key `description` in vulnerability %ld either missing or not a string.\n", i);
-          return 1;
-        }
+  const char *value = NULL;
+  size_t length = 0;
+  int err = stream_read_string (stream, &value, &length);
+  if (err)
+    return err;
 
-      json_object *location = json_object_object_get (vuln, "location");
-      if (!location || json_object_get_type (location) != json_type_object)
-        {
-          fprintf (stderr, "data.c : validate_semgrep_json() : malformed json : key `location` in vulnerability %ld either missing or not an object.\n", i);
-          return 1;
-        }
+  raw->strings[field] = arena_strndup (raw->arena, value, length);
+  raw->states[field] = FIELD_PRESENT;
+  return 0;
+}
+
+/*
+ * Find which field `key` is about.
+ *
+ * Returns FIELD_COUNT if we're not interested in that key.
+ */
+static int
+find_field (const char *key, bool in_location)
+{
+  uint64_t hash = hash_bytes (key, strlen (key));
+
+  for (size_t slot = hash & (FIELDS_TABLE_SIZE - 1); fields_table[slot]; slot = (slot + 1) & (FIELDS_TABLE_SIZE - 1))
+    {
+      int field = fields_table[slot] - 1;
+      if (field_hashes[field] == hash && strcmp (fields[field].key, key) == 0)
+        return fields[field].in_location == in_location ? field : FIELD_COUNT;
+    }
+
+  return FIELD_COUNT;
+}
+
+/*
+ * Tell if `field` is used by `schema`.
+ */
+static bool
+uses_field (const schema_t *schema, int field)
+{
+  return used_fields[schema - schemas] & (1u << field);
+}
+
+/*
+ * Read the members of an object, extracting the ones listed in `fields`.
+ *
+ * Returns non-zero in case of error.
+ */
+static int
+read_fields (stream_t *stream, raw_vulnerability_t *raw, bool in_location)
+{
+  int err = 0;
+  bool first = true;
+  bool done = false;
+  char key[STREAM_MAX_KEY_LENGTH] = {0};
+
+  while (true)
+    {
+      err = stream_next_member (stream, &first, key, &done);
+      if (err || done)
+        return err;
 
-      json_object *file = json_object_object_get (location, "file");
-      if (!file || json_object_get_type (file) != json_type_string)
+      if (!in_location && strcmp (key, "location") == 0)
         {
-          fprintf (stderr, "data.c : validate_semgrep_json() : malformed json : key `file` in vulnerability %ld's location either missing or not a string.\n", i);
-          return 1;
+          if (stream_peek_type (stream) != STREAM_OBJECT)
+            {
+              raw->location_state = FIELD_INVALID;
+              err = stream_skip_value (stream);
+            }
+          else
+            {
+              raw->location_state = FIELD_PRESENT;
+              err = read_fields (stream, raw, true);
+            }
         }
-
-      json_object *line = json_object_object_get (location, "start_line");
-      if (!line || json_object_get_type (line) != json_type_int)
+      else
         {
-          fprintf (stderr, "data.c : validate_semgrep_json() : malformed json : key `start_line` in vulnerability %ld's location either missing or not an integer.\n", i);
-          return 1;
+          int field = find_field (key, in_location);
+          if (field == FIELD_COUNT || (raw->schema && !uses_field (raw->schema, field)))
+            err = stream_skip_value (stream);
+          else
+            err = read_field (stream, raw, field);
         }
+
+      if (err)
+        return err;
     }
+}
 
-  return 0;
+/*
+ * Read the vulnerability at current position.
+ *
+ * Returns non-zero in case of error.
+ */
+static int
+read_vulnerability (stream_t *stream, raw_vulnerability_t *raw)
+{
+  if (stream_peek_type (stream) != STREAM_OBJECT)
+    return stream_skip_value (stream);
+
+  raw->is_object = true;
+  return read_fields (stream, raw, false);
 }
 
 /*
- * Makes sure the provided flawfinder data is formatted as expected.
+ * Read the `vulnerabilities` array.
+ *
+ * If `report->offsets_only` is set, vulnerabilities are only skipped,
+ * and their position is recorded so they can be read later.
  *
  * Returns non-zero in case of error.
  */
 static int
-validate_flawfinder_json (const json_object *vulns)
+read_vulnerabilities (stream_t *stream, report_t *report)
 {
-  size_t array_len = json_object_array_length (vulns);
-  if (array_len > MAX_VULNERABILITY_COUNT)
-    array_len = MAX_VULNERABILITY_COUNT;
+  int err = 0;
+  bool first = true;
+  bool done = false;
 
-  for (size_t i = 0; i < array_len; i++)
+  while (true)
     {
-      json_object *vuln = json_object_array_get_idx (vulns, i);
-      if (json_object_get_type (vuln) != json_type_object)
+      err = stream_next_element (stream, &first, &done);
+      if (err || done)
+        return err;
+
+      if (report->offsets_only)
         {
-          fprintf (stderr, "data.c : validate_flawfinder_json() : malformed json : vulnerability %ld is not an object.\n", i);
-          return 1;
+          stream_peek_type (stream);
+          report->offsets = xgrow (report->offsets, sizeof (*report->offsets), report->offsets_count + 1, &report->offsets_capacity);
+          report->offsets[report->offsets_count++] = stream_tell (stream);
+          err = stream_skip_value (stream);
         }
-
-      json_object *category = json_object_object_get (vuln, "category");
-      if (!category || json_object_get_type (category) != json_type_string)
+      else
         {
-          fprintf (stderr, "data.c : validate_flawfinder_json() : malformed json : key `category` in vulnerability %ld either missing or not a string.\n", i);
-          return 1;
+          report->raws = xgrow (report->raws, sizeof (*report->raws), report->raws_count + 1, &report->raws_capacity);
+          raw_vulnerability_t *raw = &report->raws[report->raws_count++];
+          raw->arena = &report->arena;
+          err = read_vulnerability (stream, raw);
         }
 
-      json_object *cve = json_object_object_get (vuln, "cve");
-      if (!cve || json_object_get_type (cve) != json_type_string)
+      if (err)
+        return err;
+    }
+}
+
+/*
+ * Find `/scan/analyzer/id` in the `scan` object.
+ *
+ * Returns non-zero in case of error.
+ */
+static int
+read_scan (stream_t *stream, report_t *report, int depth)
+{
+  int err = 0;
+  bool first = true;
+  bool done = false;
+  char key[STREAM_MAX_KEY_LENGTH] = {0};
+  const char *wanted = depth == 0 ? "analyzer" : "id";
+
+  while (true)
+    {
+      err = stream_next_member (stream, &first, key, &done);
+      if (err || done)
+        return err;
+
+      if (strcmp (key, wanted) != 0)
+        err = stream_skip_value (stream);
+      else if (depth == 0 && stream_peek_type (stream) == STREAM_OBJECT)
+        err = read_scan (stream, report, depth + 1);
+      else if (depth == 1 && stream_peek_type (stream) == STREAM_STRING)
         {
-          fprintf (stderr, "data.c : validate_flawfinder_json() : malformed json : key `cve` in vulnerability %ld either missing or not a string.\n", i);
-          return 1;
+          const char *value = NULL;
+          size_t length = 0;
+          err = stream_read_string (stream, &value, &length);
+          if (!err)
+            {
+              if (report->analyzer) free (report->analyzer);
+              report->analyzer = strndup (value, length);
+              report->analyzer_state = FIELD_PRESENT;
+            }
         }
-
-      json_object *message = json_object_object_get (vuln, "message");
-      if (!message || json_object_get_type (message) != json_type_string)
+      else
         {
-          fprintf (stderr, "data.c : validate_flawfinder_json() : malformed json : key `message` in vulnerability %ld either missing or not a string.\n", i);
-          return 1;
+          if (depth == 1)
+            report->analyzer_state = FIELD_INVALID;
+
+          err = stream_skip_value (stream);
         }
 
-      json_object *location = json_object_object_get (vuln, "location");
-      if (!location || json_object_get_type (location) != json_type_object)
+      if (err)
+        return err;
+    }
+}
+
+/*
+ * Stream the whole report, keeping only what we need.
+ *
+ * Returns non-zero in case of error.
+ */
+static int
+read_report (stream_t *stream, report_t *report)
+{
+  int err = 0;
+  bool first = true;
+  bool done = false;
+  char key[STREAM_MAX_KEY_LENGTH] = {0};
+
+  if (stream_peek_type (stream) != STREAM_OBJECT)
+    return 0;
+
+  report->is_object = true;
+
+  while (true)
+    {
+      err = stream_next_member (stream, &first, key, &done);
+      if (err)
+        return err;
+
+      if (done)
+        break;
+
+      if (strcmp (key, "version") == 0)
         {
-          fprintf (stderr, "data.c : validate_flawfinder_json() : malformed json : key `location` in vulnerability %ld either missing or not an object.\n", i);
-          return 1;
+          report->has_version = true;
+          err = stream_skip_value (stream);
         }
-
-      json_object *file = json_object_object_get (location, "file");
-      if (!file || json_object_get_type (file) != json_type_string)
+      else if (strcmp (key, "vulnerabilities") == 0)
         {
-          fprintf (stderr, "data.c : validate_flawfinder_json() : malformed json : key `file` in vulnerability %ld's location either missing or not a string.\n", i);
-          return 1;
+          report->has_vulnerabilities = true;
+          report->vulnerabilities_is_array = stream_peek_type (stream) == STREAM_ARRAY;
+          if (report->vulnerabilities_is_array)
+            err = read_vulnerabilities (stream, report);
+          else
+            err = stream_skip_value (stream);
         }
+      else if (strcmp (key, "scan") == 0 && stream_peek_type (stream) == STREAM_OBJECT)
+        err = read_scan (stream, report, 0);
+      else
+        err = stream_skip_value (stream);
+
+      if (err)
+        return err;
+    }
+
+  return stream_finish (stream);
+}
+
+/*
+ * Release memory held by report.
+ */
+static void
+free_report (report_t *report)
+{
+  free_arena (&report->arena);
+  if (report->raws) free (report->raws);
+  if (report->offsets) free (report->offsets);
+  if (report->analyzer) free (report->analyzer);
+}
+
+/*
+ * Find what prevents `vuln` from being used with `schema`.
+ *
+ * A required slot is at fault when its first candidate which is not
+ * missing is invalid, or when all are missing, in which case the first
+ * one is reported.
+ *
+ * Returns PROBLEM_NONE if it's usable, the field at fault if there is
+ * one, or PROBLEM_NOT_OBJECT / PROBLEM_LOCATION.
+ */
+static int
+check_vulnerability (const schema_t *schema, const raw_vulnerability_t *vuln)
+{
+  if (!vuln->is_object)
+    return PROBLEM_NOT_OBJECT;
 
-      json_object *line = json_object_object_get (location, "start_line");
-      if (!line || json_object_get_type (line) != json_type_int)
+  for (int slot = 0; slot < SLOT_COUNT; slot++)
+    {
+      const slot_schema_t *spec = &schema->slots[slot];
+      if (spec->optional)
+        continue;
+
+      int found = FIELD_COUNT;
+      for (const int *field = spec->candidates; *field != FIELD_COUNT && found == FIELD_COUNT; field++)
         {
-          fprintf (stderr, "data.c : validate_flawfinder_json() : malformed json : key `start_line` in vulnerability %ld's location either missing or not an integer.\n", i);
-          return 1;
+          if (fields[*field].in_location && vuln->location_state != FIELD_PRESENT)
+            return PROBLEM_LOCATION;
+
+          if (vuln->states[*field] == FIELD_INVALID)
+            return *field;
+
+          if (vuln->states[*field] == FIELD_PRESENT)
+            found = *field;
         }
+
+      if (found == FIELD_COUNT)
+        return spec->candidates[0];
     }
 
-  return 0;
+  return PROBLEM_NONE;
+}
+
+/*
+ * Explain what `check_vulnerability()` found about vulnerability `i`.
+ */
+static void
+print_problem (size_t i, int problem)
+{
+  if (problem == PROBLEM_NOT_OBJECT)
+    fprintf (stderr, "data.c : check_vulnerability() : malformed json : vulnerability %ld is not an object.\n", i);
+  else if (problem == PROBLEM_LOCATION)
+    fprintf (stderr, "data.c : check_vulnerability() : malformed json : key `location` in vulnerability %ld either missing or not an object.\n", i);
+  else if (problem == FIELD_START_LINE)
+    fprintf (stderr, "data.c : check_vulnerability() : malformed json : key `start_line` in vulnerability %ld's location either missing or not an integer.\n", i);
+  else if (fields[problem].in_location)
+    fprintf (stderr, "data.c : check_vulnerability() : malformed json : key `%s` in vulnerability %ld's location either missing or not a string.\n", fields[problem].key, i);
+  else
+    fprintf (stderr, "data.c : check_vulnerability() : malformed json : key `%s` in vulnerability %ld either missing or not a string.\n", fields[problem].key, i);
 }
 
 /*
- * Makes sure the provided data is formatted as expected.
+ * Makes sure the provided data is formatted as expected, and find
+ * the schema of the analyzer which produced it.
+ *
+ * Vulnerabilities themselves are checked while being extracted.
  *
  * Returns non-zero in case of error.
  */
 static int
-validate_json (const json_object *data)
+validate_json (report_t *report)
 {
-  if (!json_object_object_get (data, "version") || !json_object_object_get (data, "vulnerabilities"))
+  if (!report->is_object || !report->has_version || !report->has_vulnerabilities)
     {
       fprintf (stderr, "data.c : validate_json() : this does not seem to be a Gitlab's SAST file.\n");
       return 1;
     }
 
-  json_object *vulns = json_object_object_get (data, "vulnerabilities");
-  if (json_object_get_type (vulns) != json_type_array)
+  if (!report->vulnerabilities_is_array)
     {
       fprintf (stderr, "data.c : validate_json() : malformed json : `vulnerabilities` is not an array.\n");
       return 1;
     }
 
-  json_object *analyzer = NULL;
-  int err = json_pointer_get ((json_object *) data, "/scan/analyzer/id", &analyzer);
-  if (err)
+  if (report->analyzer_state == FIELD_MISSING)
     {
-      fprintf (stderr, "data.c : validate_json() : malformed json : `no analyzer info.\n");
+      fprintf (stderr, "data.c : validate_json() : malformed json : no analyzer info.\n");
       return 1;
     }
 
-  if (json_object_get_type (analyzer) != json_type_string)
+  if (report->analyzer_state == FIELD_INVALID)
     {
-      fprintf (stderr, "data.c : validate_json() : malformed json : `analyzer id is not a string.\n");
+      fprintf (stderr, "data.c : validate_json() : malformed json : analyzer id is not a string.\n");
       return 1;
     }
 
-  if (strncmp (json_object_get_string (analyzer), "semgrep", 100) == 0)
-    {
-      analyzer_format = ANALYZER_SEMGREP;
-      return validate_semgrep_json (vulns);
-    }
-
-  if (strncmp (json_object_get_string (analyzer), "flawfinder", 100) == 0)
-    {
-      analyzer_format = ANALYZER_FLAWFINDER;
-      return validate_flawfinder_json (vulns);
-    }
+  for (size_t i = 0; i < SCHEMAS_COUNT; i++)
+    if (strcmp (report->analyzer, schemas[i].analyzer) == 0)
+      {
+        report->schema = &schemas[i];
+        return 0;
+      }
 
   printf ("Sorry, this analyzer is not supported.\n\n");
   fprintf (stderr, "data.c : validate_json() : unsupported analyzer.\n");
@@ -201,139 +674,426 @@ validate_json (const json_object *data)
 }
 
 /*
- * Retrieve flawfinder data in json file.
+ * Find the first of the candidates of `spec` present in `vuln`.
+ *
+ * Returns FIELD_COUNT if there is none.
  */
-static void
-fill_flawfinder_data (const json_object *vuln, size_t i, vulnerability_t vulns[MAX_VULNERABILITY_COUNT], size_t *vulns_count)
+static int
+present_field (const slot_schema_t *spec, const raw_vulnerability_t *vuln)
+{
+  const int *field = spec->candidates;
+  while (*field != FIELD_COUNT && vuln->states[*field] != FIELD_PRESENT)
+    field++;
+
+  return *field;
+}
+
+/*
+ * Find the level named `name` among `names`, ignoring case.
+ *
+ * Returns 0, the unknown level, if there is no such level.
+ */
+static int
+find_level (const char **names, int count, const char *name)
 {
-  vulns[i].category = strndup (json_object_get_string (json_object_object_get (vuln, "category")), MAX_CATEGORY_LENGTH - 1);
-  vulns[i].title = strndup (json_object_get_string (json_object_object_get (vuln, "cve")), MAX_TITLE_LENGTH - 1);
-  char description[MAX_DESC_LENGTH] = {0};
-  const char *message = json_object_get_string (json_object_object_get (vuln, "message"));
-  const char *solution = "?";
-  json_object *jsolution = json_object_object_get (vuln, "solution");
-  if (jsolution)
-    solution = json_object_get_string (jsolution);
-  snprintf (description, MAX_DESC_LENGTH - 1, "Message: %s\n\nSolution: %s\n", message, solution);
-  vulns[i].description = strndup (description, MAX_DESC_LENGTH - 1);
-
-  json_object *location = json_object_object_get (vuln, "location");
-  vulns[i].file = strndup (json_object_get_string (json_object_object_get (location, "file")), MAX_LOCATION_LENGTH - 1);
-  vulns[i].line = json_object_get_int64 (json_object_object_get (location, "start_line"));
-
-  (*vulns_count)++;
+  for (int level = 1; level < count; level++)
+    if (strcasecmp (names[level], name) == 0)
+      return level;
+
+  return 0;
 }
 
 /*
- * Retrieve semgrep data in json file.
+ * Move the content of `vuln` into `target`, following `schema`, once
+ * `check_vulnerability()` accepted it. Strings are not copied, they
+ * stay in the arena of `vuln`.
  */
 static void
-fill_semgrep_data (const json_object *vuln, size_t i, vulnerability_t vulns[MAX_VULNERABILITY_COUNT], size_t *vulns_count)
+fill_vulnerability (const schema_t *schema, raw_vulnerability_t *vuln, vulnerability_t *target)
 {
-  vulns[i].category = strndup (json_object_get_string (json_object_object_get (vuln, "category")), MAX_CATEGORY_LENGTH - 1);
-  vulns[i].title = strndup (json_object_get_string (json_object_object_get (vuln, "title")), MAX_TITLE_LENGTH - 1);
-  vulns[i].description = strndup (json_object_get_string (json_object_object_get (vuln, "description")), MAX_DESC_LENGTH - 1);
+  // line is the only number, it's always `start_line`.
+  char **strings[SLOT_LINE] = {
+    [SLOT_CATEGORY] = &target->category,
+    [SLOT_TITLE] = &target->title,
+    [SLOT_DESCRIPTION] = &target->description,
+    [SLOT_SOLUTION] = &target->solution,
+    [SLOT_FILE] = &target->file,
+  };
+
+  for (int slot = 0; slot < SLOT_LINE; slot++)
+    {
+      const slot_schema_t *spec = &schema->slots[slot];
+      int field = present_field (spec, vuln);
 
-  json_object *location = json_object_object_get (vuln, "location");
-  vulns[i].file = strndup (json_object_get_string (json_object_object_get (location, "file")), MAX_LOCATION_LENGTH - 1);
-  vulns[i].line = json_object_get_int64 (json_object_object_get (location, "start_line"));
+      if (field != FIELD_COUNT)
+        *strings[slot] = vuln->strings[field];
+      else if (spec->fallback)
+        *strings[slot] = arena_strndup (vuln->arena, spec->fallback, strlen (spec->fallback));
+    }
+
+  int severity = present_field (&schema->slots[SLOT_SEVERITY], vuln);
+  target->severity = severity == FIELD_COUNT ? SEVERITY_UNKNOWN : find_level (severity_names, SEVERITIES_COUNT, vuln->strings[severity]);
+
+  int confidence = present_field (&schema->slots[SLOT_CONFIDENCE], vuln);
+  target->confidence = confidence == FIELD_COUNT ? CONFIDENCE_UNKNOWN : find_level (confidence_names, CONFIDENCES_COUNT, vuln->strings[confidence]);
 
-  (*vulns_count)++;
+  target->analyzer = schema->analyzer;
+  target->line = vuln->line;
 }
 
 /*
- * Populate the data structure with data fetched from json file.
+ * Check vulnerabilities streamed in `report` and move them to
+ * `vulnerabilities`, in a single pass. Their strings are moved along
+ * with the arena of `report`.
  *
  * Returns non-zero in case of error.
  */
 static int
-fill_data (const json_object *data, vulnerability_t vulnerabilities[MAX_VULNERABILITY_COUNT], size_t *vulnerabilities_count)
+extract_raws (report_t *report, vulnerability_list_t *vulnerabilities)
+{
+  size_t first = vulnerabilities->count;
+  vulnerabilities->items = xgrow (vulnerabilities->items, sizeof (*vulnerabilities->items), vulnerabilities->count + report->raws_count, &vulnerabilities->capacity);
+
+  for (size_t i = 0; i < report->raws_count; i++)
+    {
+      raw_vulnerability_t *vuln = &report->raws[i];
+      int problem = check_vulnerability (report->schema, vuln);
+      if (problem != PROBLEM_NONE)
+        {
+          print_problem (i, problem);
+          memset (&vulnerabilities->items[first], 0, (vulnerabilities->count - first) * sizeof (*vulnerabilities->items));
+          vulnerabilities->count = first;
+          return 1;
+        }
+
+      fill_vulnerability (report->schema, vuln, &vulnerabilities->items[vulnerabilities->count++]);
+    }
+
+  arena_merge (&vulnerabilities->strings, &report->arena);
+  return 0;
+}
+
+/*
+ * Read, check and fill the vulnerabilities of `job`.
+ *
+ * This runs on its own thread: it stops at the first problem, and
+ * leaves it to the caller to report it.
+ */
+static void *
+extract_range (void *data)
 {
-  json_object *vulns = json_object_object_get (data, "vulnerabilities");
-  size_t array_len = json_object_array_length (vulns);
-  if (array_len > MAX_VULNERABILITY_COUNT)
-    array_len = MAX_VULNERABILITY_COUNT;
+  extract_job_t *job = data;
+  stream_t stream;
 
-  for (size_t i = 0; i < array_len; i++)
+  stream_open_memory (&stream, job->data, job->size);
+  job->problem = PROBLEM_NONE;
+
+  for (size_t i = job->from; i < job->to; i++)
     {
-      json_object *vuln = json_object_array_get_idx (vulns, i);
+      raw_vulnerability_t raw = { .arena = &job->arena, .schema = job->schema };
+      stream_seek (&stream, job->offsets[i]);
+      job->err = read_vulnerability (&stream, &raw);
+      if (!job->err)
+        {
+          job->problem = check_vulnerability (job->schema, &raw);
+          if (job->problem == PROBLEM_NONE)
+            fill_vulnerability (job->schema, &raw, &job->items[i]);
+        }
 
-      switch (analyzer_format)
+      if (job->err || job->problem != PROBLEM_NONE)
         {
-          case ANALYZER_FLAWFINDER:
-            fill_flawfinder_data (vuln, i, vulnerabilities, vulnerabilities_count);
-            break;
+          job->failed_index = i;
+          break;
+        }
+    }
+
+  stream_close (&stream);
+  return NULL;
+}
 
-          case ANALYZER_SEMGREP:
-            fill_semgrep_data (vuln, i, vulnerabilities, vulnerabilities_count);
-            break;
+/*
+ * Extract vulnerabilities at `report->offsets` in the mapped report,
+ * splitting them in ranges across worker threads.
+ *
+ * Each vulnerability goes to its own slot, so the result is in the same
+ * order than in the report, and the problem reported is the one of the
+ * first faulty vulnerability, like when extracting sequentially.
+ *
+ * Returns non-zero in case of error.
+ */
+static int
+extract_offsets (report_t *report, const char *data, size_t size, vulnerability_list_t *vulnerabilities)
+{
+  int err = 0;
+  size_t count = report->offsets_count;
+  vulnerabilities->items = xgrow (vulnerabilities->items, sizeof (*vulnerabilities->items), vulnerabilities->count + count, &vulnerabilities->capacity);
+  vulnerability_t *items = &vulnerabilities->items[vulnerabilities->count];
+
+  long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  size_t threads_count = cpus > 1 ? cpus : 1;
+  if (threads_count > MAX_THREADS)
+    threads_count = MAX_THREADS;
+
+  if (threads_count > count / MIN_VULNERABILITIES_PER_THREAD)
+    threads_count = count / MIN_VULNERABILITIES_PER_THREAD;
+
+  if (threads_count == 0)
+    threads_count = 1;
+
+  extract_job_t jobs[MAX_THREADS] = {0};
+  pthread_t threads[MAX_THREADS];
+  bool started[MAX_THREADS] = {0};
+
+  for (size_t i = 0; i < threads_count; i++)
+    {
+      jobs[i].schema = report->schema;
+      jobs[i].data = data;
+      jobs[i].size = size;
+      jobs[i].offsets = report->offsets;
+      jobs[i].from = count * i / threads_count;
+      jobs[i].to = count * (i + 1) / threads_count;
+      jobs[i].items = items;
+
+      // first range is done on current thread, once others are started.
+      if (i > 0)
+        started[i] = pthread_create (&threads[i], NULL, extract_range, &jobs[i]) == 0;
+    }
+
+  extract_range (&jobs[0]);
+
+  for (size_t i = 1; i < threads_count; i++)
+    {
+      if (started[i])
+        pthread_join (threads[i], NULL);
+      else
+        extract_range (&jobs[i]);
+    }
 
-          default:
-            fprintf (stderr, "data.c : fill_data() : unkown analyzer: %d\n", analyzer_format);
-            return 1;
+  for (size_t i = 0; i < threads_count; i++)
+    {
+      if (jobs[i].problem != PROBLEM_NONE)
+        print_problem (jobs[i].failed_index, jobs[i].problem);
+
+      if (jobs[i].err || jobs[i].problem != PROBLEM_NONE)
+        {
+          err = 1;
+          break;
         }
+    }
+
+  for (size_t i = 0; i < threads_count; i++)
+    {
+      if (err)
+        free_arena (&jobs[i].arena);
+      else
+        arena_merge (&vulnerabilities->strings, &jobs[i].arena);
+    }
 
+  if (err)
+    {
+      memset (items, 0, count * sizeof (*items));
+      return err;
     }
 
+  vulnerabilities->count += count;
   return 0;
 }
 
 /*
- * Parse data at uri.
+ * Map report open as `fd`, whose status is `info`, in memory.
+ *
+ * The file is checked again once mapped: if its size or modification
+ * time changed, it's being written, and reading the mapping could go
+ * past its end, so it's not used.
+ *
+ * Returns MAP_FAILED in case of error, or if the file is not stable.
+ */
+static char *
+map_report (int fd, const struct stat *info)
+{
+  char *data = mmap (NULL, info->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED)
+    return MAP_FAILED;
+
+  struct stat current;
+  if (fstat (fd, &current) || current.st_size != info->st_size
+      || current.st_mtim.tv_sec != info->st_mtim.tv_sec || current.st_mtim.tv_nsec != info->st_mtim.tv_nsec)
+    {
+      munmap (data, info->st_size);
+      return MAP_FAILED;
+    }
+
+  return data;
+}
+
+/*
+ * Parse data at uri, which is "-" for standard input.
  *
- * If everything goes as expected, vulnerabilities will be stored in
- * `vulnerabilities` and their count will be in `vulnerabilities_count`.
- * You're responsible to provide memory for both, and to free vulnerabilities
- * content with `free_data()`.
+ * The file is streamed rather than loaded as a whole, and only the keys
+ * we need are kept in memory. Vulnerabilities are checked and extracted
+ * in a single pass, on several threads for big reports. Compressed
+ * reports are decompressed while being parsed, on a separate thread.
+ *
+ * If everything goes as expected, vulnerabilities will be appended to
+ * `vulnerabilities`, which grows as needed. You're responsible to free
+ * it with `free_data()`.
  *
  * Returns non-zero in case of error.
  */
 int
-parse_data (const char *uri, vulnerability_t vulnerabilities[MAX_VULNERABILITY_COUNT], size_t *vulnerabilities_count)
+parse_data (const char *uri, vulnerability_list_t *vulnerabilities)
 {
   int err = 0;
-  json_object *data = NULL;
+  stream_t stream = { .fd = -1 };
+  report_t report = {0};
+  char *data = MAP_FAILED;
+  size_t size = 0;
+  int fd = -1;
 
-  err = access (uri, R_OK);
-  if (err)
+  pthread_once (&schemas_prepared, prepare_schemas);
+
+  // the file is only opened once, everything else goes through `fd`, so
+  // that it can't be replaced meanwhile.
+  bool from_stdin = strcmp (uri, "-") == 0;
+  fd = from_stdin ? -1 : open (uri, O_RDONLY);
+  if (!from_stdin && fd < 0)
     {
+      err = 1;
       fprintf (stderr, "data.c : parse_data() : file does not exist or is not readable : %s\n", uri);
       goto cleanup;
     }
 
-  data = json_object_from_file (uri);
+  // Big reports are mapped, so that vulnerabilities can be extracted in
+  // parallel once the first pass has found where they are. Compressed
+  // ones, and ones being written, are streamed: we don't want them
+  // decompressed in memory, nor to read past the end of a mapping.
+  struct stat info;
+  if (!from_stdin && fstat (fd, &info) == 0 && S_ISREG (info.st_mode) && info.st_size >= PARALLEL_THRESHOLD && sysconf (_SC_NPROCESSORS_ONLN) > 1)
+    {
+      data = map_report (fd, &info);
+      size = info.st_size;
+      if (data != MAP_FAILED && detect_compression (data, size) != COMPRESSION_NONE)
+        {
+          munmap (data, size);
+          data = MAP_FAILED;
+        }
+    }
+
+  if (data != MAP_FAILED)
+    {
+      stream_open_memory (&stream, data, size);
+      report.offsets_only = true;
+    }
+  else
+    {
+      err = from_stdin ? stream_open (&stream, uri) : stream_open_fd (&stream, fd);
+      fd = -1;
+      if (err)
+        {
+          fprintf (stderr, "data.c : parse_data() : can't open file : %s\n", uri);
+          goto cleanup;
+        }
+    }
+
+  uint64_t timer = start_timer ();
+  err = read_report (&stream, &report);
+  stop_timer (STAGE_READ_REPORT, timer);
+  count_stat (COUNTER_BYTES_READ, stream_tell (&stream));
+  if (err && stream.failed)
+    {
+      fprintf (stderr, "data.c : parse_data() : can't read the whole file.\n");
+      goto cleanup;
+    }
+  else if (err)
+    {
+      fprintf (stderr, "data.c : parse_data() : this does not seem to be a valid json file.\n");
+      goto cleanup;
+    }
 
-  err = validate_json (data);
+  timer = start_timer ();
+  err = validate_json (&report);
+  stop_timer (STAGE_VALIDATE, timer);
   if (err)
     {
       fprintf (stderr, "data.c : parse_data() : error while validating data.\n");
       goto cleanup;
     }
 
-  err = fill_data (data, vulnerabilities, vulnerabilities_count);
+  timer = start_timer ();
+  if (report.offsets_only)
+    err = extract_offsets (&report, data, size, vulnerabilities);
+  else
+    err = extract_raws (&report, vulnerabilities);
+
+  stop_timer (STAGE_EXTRACT, timer);
+
   if (err)
     {
-      fprintf (stderr, "data.c : parse_data() : error while filling data.\n");
+      fprintf (stderr, "data.c : parse_data() : error while extracting data.\n");
       goto cleanup;
     }
 
   cleanup:
-  json_object_put (data);
+  stream_close (&stream);
+  if (fd >= 0) close (fd);
+  if (data != MAP_FAILED) munmap (data, size);
+  free_report (&report);
   return err;
 }
 
+const char *
+severity_name (int severity)
+{
+  return severity_names[severity];
+}
+
+const char *
+confidence_name (int confidence)
+{
+  return confidence_names[confidence];
+}
+
 /*
- * Free vulnerabilities memory.
+ * Move vulnerabilities of `other` at the end of `vulnerabilities`,
+ * along with the memory their strings are in. `other` is left empty.
  */
 void
-free_data (vulnerability_t vulnerabilities[MAX_VULNERABILITY_COUNT], size_t vulnerabilities_count)
+merge_data (vulnerability_list_t *vulnerabilities, vulnerability_list_t *other)
 {
-  for (size_t i = 0; i < vulnerabilities_count; i++)
+  if (vulnerabilities->count == 0 && !vulnerabilities->items && !vulnerabilities->mappings)
     {
-      vulnerability_t *vuln = &vulnerabilities[i];
-      if (vuln->category) free (vuln->category);
-      if (vuln->title) free (vuln->title);
-      if (vuln->description) free (vuln->description);
-      if (vuln->file) free (vuln->file);
+      arena_merge (&other->strings, &vulnerabilities->strings);
+      *vulnerabilities = *other;
+      memset (other, 0, sizeof (*other));
+      return;
     }
+
+  vulnerabilities->items = xgrow (vulnerabilities->items, sizeof (*vulnerabilities->items), vulnerabilities->count + other->count, &vulnerabilities->capacity);
+  memcpy (&vulnerabilities->items[vulnerabilities->count], other->items, other->count * sizeof (*other->items));
+  vulnerabilities->count += other->count;
+
+  arena_merge (&vulnerabilities->strings, &other->strings);
+
+  vulnerabilities->mappings = xgrow (vulnerabilities->mappings, sizeof (mapping_t), vulnerabilities->mappings_count + other->mappings_count, &vulnerabilities->mappings_capacity);
+  memcpy (&vulnerabilities->mappings[vulnerabilities->mappings_count], other->mappings, other->mappings_count * sizeof (mapping_t));
+  vulnerabilities->mappings_count += other->mappings_count;
+
+  if (other->items) free (other->items);
+  if (other->mappings) free (other->mappings);
+  memset (other, 0, sizeof (*other));
+}
+
+/*
+ * Free vulnerabilities memory, all strings at once.
+ */
+void
+free_data (vulnerability_list_t *vulnerabilities)
+{
+  for (size_t i = 0; i < vulnerabilities->mappings_count; i++)
+    munmap (vulnerabilities->mappings[i].data, vulnerabilities->mappings[i].size);
+
+  free_arena (&vulnerabilities->strings);
+  if (vulnerabilities->items) free (vulnerabilities->items);
+  if (vulnerabilities->mappings) free (vulnerabilities->mappings);
+  memset (vulnerabilities, 0, sizeof (*vulnerabilities));
 }
@@ -3,21 +3,72 @@
 
 #include <stddef.h>
 
-#define MAX_VULNERABILITY_COUNT 100
-#define MAX_CATEGORY_LENGTH 500
-#define MAX_TITLE_LENGTH 1000
-#define MAX_DESC_LENGTH 100000
-#define MAX_LOCATION_LENGTH 1000
+/*
+ * Levels of severity and confidence of Gitlab's security report
+ * format, from lowest to highest. Unknown is used when the report
+ * does not tell.
+ */
+enum {
+  SEVERITY_UNKNOWN,
+  SEVERITY_INFO,
+  SEVERITY_LOW,
+  SEVERITY_MEDIUM,
+  SEVERITY_HIGH,
+  SEVERITY_CRITICAL,
+  SEVERITIES_COUNT,
+};
 
+enum {
+  CONFIDENCE_UNKNOWN,
+  CONFIDENCE_IGNORE,
+  CONFIDENCE_EXPERIMENTAL,
+  CONFIDENCE_LOW,
+  CONFIDENCE_MEDIUM,
+  CONFIDENCE_HIGH,
+  CONFIDENCE_CONFIRMED,
+  CONFIDENCES_COUNT,
+};
+
+/*
+ * When `solution` is set, `description` is a message to display along
+ * with it. `analyzer` is the id of the analyzer which found it, it's
+ * never NULL.
+ */
 typedef struct {
+  const char *analyzer;
   char *category;
   char *title;
   char *description;
+  char *solution;
   char *file;
   size_t line;
+  int severity;
+  int confidence;
 } vulnerability_t;
 
-int parse_data (const char *uri, vulnerability_t vulnerabilities[MAX_VULNERABILITY_COUNT], size_t *vulnerabilities_count);
-void free_data (vulnerability_t vulnerabilities[MAX_VULNERABILITY_COUNT], size_t vulnerabilities_count);
+typedef struct {
+  void *data;
+  size_t size;
+} mapping_t;
+
+/*
+ * Vulnerabilities strings are not allocated one by one: they're either
+ * in `strings`, or in one of `mappings` when loaded from snapshots.
+ */
+typedef struct {
+  vulnerability_t *items;
+  size_t count;
+  size_t capacity;
+  arena_t strings;
+  mapping_t *mappings;
+  size_t mappings_count;
+  size_t mappings_capacity;
+} vulnerability_list_t;
+
+int parse_data (const char *uri, vulnerability_list_t *vulnerabilities);
+const char *severity_name (int severity);
+const char *confidence_name (int confidence);
+void merge_data (vulnerability_list_t *vulnerabilities, vulnerability_list_t *other);
+void free_data (vulnerability_list_t *vulnerabilities);
 
 #endif
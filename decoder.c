@@ -0,0 +1,392 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "decoder.h"
+#include "utils.h"
+
+#define DECODER_INPUT_SIZE 65536
+
+/*
+ * Find how a report is compressed from `data`, its first `len` bytes,
+ * using magic numbers of compressed formats.
+ */
+int
+detect_compression (const char *data, size_t len)
+{
+  const unsigned char *bytes = (const unsigned char *) data;
+
+  if (len >= 2 && bytes[0] == 0x1f && bytes[1] == 0x8b)
+    return COMPRESSION_GZIP;
+
+  if (len >= 4 && bytes[0] == 0x28 && bytes[1] == 0xb5 && bytes[2] == 0x2f && bytes[3] == 0xfd)
+    return COMPRESSION_ZSTD;
+
+  return COMPRESSION_NONE;
+}
+
+/*
+ * Tell if this build can decompress `compression`. Zstd is optional.
+ */
+bool
+is_compression_supported (int compression)
+{
+#ifdef HAVE_ZSTD
+  (void) compression;
+  return true;
+#else
+  return compression != COMPRESSION_ZSTD;
+#endif
+}
+
+/*
+ * Read the next chunk of compressed input in `decoder->input`.
+ *
+ * Returns how many bytes were read, 0 at the end of input or in case
+ * of error.
+ */
+static size_t
+read_input (decoder_t *decoder)
+{
+  while (true)
+    {
+      ssize_t len = read (decoder->fd, decoder->input, DECODER_INPUT_SIZE);
+      if (len < 0 && errno == EINTR)
+        continue;
+
+      if (len < 0)
+        fprintf (stderr, "decoder.c : read_input() : can't read file : %s\n", strerror (errno));
+
+      return len > 0 ? len : 0;
+    }
+}
+
+/*
+ * Wait until a slot is free, and return it.
+ *
+ * Returns NULL if decoding must stop.
+ */
+static decoder_slot_t *
+next_free_slot (decoder_t *decoder)
+{
+  pthread_mutex_lock (&decoder->lock);
+
+  while (decoder->count == DECODER_SLOTS && !decoder->stopping)
+    pthread_cond_wait (&decoder->changed, &decoder->lock);
+
+  decoder_slot_t *slot = NULL;
+  if (!decoder->stopping)
+    slot = &decoder->slots[(decoder->tail + decoder->count) % DECODER_SLOTS];
+
+  pthread_mutex_unlock (&decoder->lock);
+  return slot;
+}
+
+/*
+ * Hand the slot returned by last `next_free_slot()` to the consumer.
+ */
+static void
+publish_slot (decoder_t *decoder)
+{
+  pthread_mutex_lock (&decoder->lock);
+  decoder->count++;
+  pthread_cond_broadcast (&decoder->changed);
+  pthread_mutex_unlock (&decoder->lock);
+}
+
+/*
+ * Inflate gzip input. It may have several members, like `cat a.gz b.gz`
+ * makes.
+ *
+ * Returns non-zero in case of error.
+ */
+static int
+decode_gzip (decoder_t *decoder)
+{
+  int err = 0;
+  z_stream zstream = {0};
+  bool finished = false;
+  bool in_member = false;
+  decoder_slot_t *slot = NULL;
+
+  // 16 makes zlib expect a gzip header.
+  if (inflateInit2 (&zstream, 15 + 16) != Z_OK)
+    {
+      fprintf (stderr, "decoder.c : decode_gzip() : can't initialize zlib.\n");
+      return 1;
+    }
+
+  zstream.next_in = (Bytef *) decoder->input;
+  zstream.avail_in = decoder->input_length;
+  bool needs_input = zstream.avail_in == 0;
+
+  while (!finished && !err && (slot = next_free_slot (decoder)))
+    {
+      zstream.next_out = (Bytef *) slot->data;
+      zstream.avail_out = DECODER_SLOT_SIZE;
+
+      while (zstream.avail_out > 0 && !finished && !err)
+        {
+          if (needs_input)
+            {
+              zstream.next_in = (Bytef *) decoder->input;
+              zstream.avail_in = read_input (decoder);
+              finished = zstream.avail_in == 0;
+              needs_input = false;
+              continue;
+            }
+
+          unsigned int available = zstream.avail_in;
+          int ret = inflate (&zstream, Z_NO_FLUSH);
+          if (ret == Z_STREAM_END)
+            {
+              in_member = false;
+              inflateReset (&zstream);
+            }
+          else if (ret == Z_OK || ret == Z_BUF_ERROR)
+            in_member |= zstream.avail_in < available;
+          else
+            {
+              fprintf (stderr, "decoder.c : decode_gzip() : corrupted gzip data.\n");
+              err = 1;
+            }
+
+          // all input is used and all output is flushed.
+          needs_input = zstream.avail_in == 0 && (zstream.avail_out > 0 || ret == Z_BUF_ERROR);
+        }
+
+      slot->length = DECODER_SLOT_SIZE - zstream.avail_out;
+      if (slot->length > 0)
+        publish_slot (decoder);
+    }
+
+  if (finished && in_member)
+    {
+      fprintf (stderr, "decoder.c : decode_gzip() : truncated gzip data.\n");
+      err = 1;
+    }
+
+  inflateEnd (&zstream);
+  return err;
+}
+
+#ifdef HAVE_ZSTD
+/*
+ * Decompress zstd input. It may have several frames.
+ *
+ * Returns non-zero in case of error.
+ */
+static int
+decode_zstd (decoder_t *decoder)
+{
+  int err = 0;
+  bool finished = false;
+  bool in_frame = false;
+  decoder_slot_t *slot = NULL;
+
+  ZSTD_DStream *zstream = ZSTD_createDStream ();
+  if (!zstream || ZSTD_isError (ZSTD_initDStream (zstream)))
+    {
+      fprintf (stderr, "decoder.c : decode_zstd() : can't initialize zstd.\n");
+      if (zstream) ZSTD_freeDStream (zstream);
+      return 1;
+    }
+
+  ZSTD_inBuffer input = { decoder->input, decoder->input_length, 0 };
+  bool needs_input = input.size == 0;
+
+  while (!finished && !err && (slot = next_free_slot (decoder)))
+    {
+      ZSTD_outBuffer output = { slot->data, DECODER_SLOT_SIZE, 0 };
+
+      while (output.pos < output.size && !finished && !err)
+        {
+          if (needs_input)
+            {
+              input.size = read_input (decoder);
+              input.pos = 0;
+              finished = input.size == 0;
+              needs_input = false;
+              continue;
+            }
+
+          size_t ret = ZSTD_decompressStream (zstream, &output, &input);
+          if (ZSTD_isError (ret))
+            {
+              fprintf (stderr, "decoder.c : decode_zstd() : corrupted zstd data : %s\n", ZSTD_getErrorName (ret));
+              err = 1;
+              break;
+            }
+
+          // 0 means a frame is complete and flushed.
+          in_frame = ret != 0;
+          needs_input = input.pos == input.size && output.pos < output.size;
+        }
+
+      slot->length = output.pos;
+      if (slot->length > 0)
+        publish_slot (decoder);
+    }
+
+  if (finished && in_frame)
+    {
+      fprintf (stderr, "decoder.c : decode_zstd() : truncated zstd data.\n");
+      err = 1;
+    }
+
+  ZSTD_freeDStream (zstream);
+  return err;
+}
+#endif
+
+static void *
+run_decoder (void *data)
+{
+  decoder_t *decoder = data;
+  int err;
+
+#ifdef HAVE_ZSTD
+  if (decoder->compression == COMPRESSION_ZSTD)
+    err = decode_zstd (decoder);
+  else
+#endif
+    err = decode_gzip (decoder);
+
+  // data before an error may still be valid json: the reader must
+  // check `decoder_error()` once it reaches the end.
+  pthread_mutex_lock (&decoder->lock);
+  decoder->done = true;
+  decoder->err = err;
+  pthread_cond_broadcast (&decoder->changed);
+  pthread_mutex_unlock (&decoder->lock);
+
+  return NULL;
+}
+
+static void
+free_decoder_buffers (decoder_t *decoder)
+{
+  for (size_t i = 0; i < DECODER_SLOTS; i++)
+    if (decoder->slots[i].data)
+      free (decoder->slots[i].data);
+
+  if (decoder->input) free (decoder->input);
+}
+
+/*
+ * Start decompressing `fd` on a separate thread. `input` is what was
+ * already read from it, to find its `compression`.
+ *
+ * Once started, the decoder owns `fd`. Decompressed data is read with
+ * `decoder_read()`. The decoder waits when all slots are full, so the
+ * whole decompressed report is never in memory.
+ *
+ * Returns non-zero in case of error.
+ */
+int
+start_decoder (decoder_t *decoder, int fd, int compression, const char *input, size_t input_length)
+{
+  memset (decoder, 0, sizeof (*decoder));
+  decoder->fd = fd;
+  decoder->compression = compression;
+  decoder->input = xalloc (input_length > DECODER_INPUT_SIZE ? input_length : DECODER_INPUT_SIZE);
+  decoder->input_length = input_length;
+  memcpy (decoder->input, input, input_length);
+
+  for (size_t i = 0; i < DECODER_SLOTS; i++)
+    decoder->slots[i].data = xalloc (DECODER_SLOT_SIZE);
+
+  pthread_mutex_init (&decoder->lock, NULL);
+  pthread_cond_init (&decoder->changed, NULL);
+
+  if (pthread_create (&decoder->thread, NULL, run_decoder, decoder))
+    {
+      fprintf (stderr, "decoder.c : start_decoder() : can't start decoder thread.\n");
+      pthread_mutex_destroy (&decoder->lock);
+      pthread_cond_destroy (&decoder->changed);
+      free_decoder_buffers (decoder);
+      return 1;
+    }
+
+  return 0;
+}
+
+/*
+ * Get the next chunk of decompressed data in `data`, waiting for it if
+ * needed. It stays valid until the next call, which gives its slot
+ * back to the decoder.
+ *
+ * Returns false at the end of data.
+ */
+bool
+decoder_read (decoder_t *decoder, const char **data, size_t *len)
+{
+  pthread_mutex_lock (&decoder->lock);
+
+  if (decoder->reading)
+    {
+      decoder->tail = (decoder->tail + 1) % DECODER_SLOTS;
+      decoder->count--;
+      decoder->reading = false;
+      pthread_cond_broadcast (&decoder->changed);
+    }
+
+  while (decoder->count == 0 && !decoder->done)
+    pthread_cond_wait (&decoder->changed, &decoder->lock);
+
+  bool available = decoder->count > 0;
+  if (available)
+    {
+      *data = decoder->slots[decoder->tail].data;
+      *len = decoder->slots[decoder->tail].length;
+      decoder->reading = true;
+    }
+
+  pthread_mutex_unlock (&decoder->lock);
+  return available;
+}
+
+/*
+ * Tell if decompression failed. Only meaningful once `decoder_read()`
+ * returned false.
+ *
+ * Returns non-zero in case of error.
+ */
+int
+decoder_error (decoder_t *decoder)
+{
+  pthread_mutex_lock (&decoder->lock);
+  int err = decoder->err;
+  pthread_mutex_unlock (&decoder->lock);
+  return err;
+}
+
+/*
+ * Stop decompressing, even if data is left, and free resources held
+ * by `decoder`.
+ */
+void
+stop_decoder (decoder_t *decoder)
+{
+  pthread_mutex_lock (&decoder->lock);
+  decoder->stopping = true;
+  pthread_cond_broadcast (&decoder->changed);
+  pthread_mutex_unlock (&decoder->lock);
+
+  pthread_join (decoder->thread, NULL);
+
+  close (decoder->fd);
+  pthread_mutex_destroy (&decoder->lock);
+  pthread_cond_destroy (&decoder->changed);
+  free_decoder_buffers (decoder);
+  memset (decoder, 0, sizeof (*decoder));
+  decoder->fd = -1;
+}
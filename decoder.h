@@ -0,0 +1,58 @@
+#ifndef _DECODER_H_
+#define _DECODER_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Decompressed data is handed to the parser in DECODER_SLOTS chunks
+ * of DECODER_SLOT_SIZE bytes, so at most that much of it is in memory.
+ */
+#define DECODER_SLOTS 4
+#define DECODER_SLOT_SIZE 65536
+#define DECODER_MAGIC_LENGTH 4
+
+enum {
+  COMPRESSION_NONE,
+  COMPRESSION_GZIP,
+  COMPRESSION_ZSTD,
+};
+
+typedef struct {
+  char *data;
+  size_t length;
+} decoder_slot_t;
+
+/*
+ * Decompresses `fd` on its own thread, into a ring of slots.
+ *
+ * The `count` slots from `tail` are filled, the first one being read
+ * by the consumer when `reading` is true. `err` is set with `done` when
+ * the input could not be fully decompressed.
+ */
+typedef struct decoder {
+  int fd;
+  int compression;
+  char *input;
+  size_t input_length;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  decoder_slot_t slots[DECODER_SLOTS];
+  size_t tail;
+  size_t count;
+  bool reading;
+  bool done;
+  int err;
+  bool stopping;
+} decoder_t;
+
+int detect_compression (const char *data, size_t len);
+bool is_compression_supported (int compression);
+int start_decoder (decoder_t *decoder, int fd, int compression, const char *input, size_t input_length);
+bool decoder_read (decoder_t *decoder, const char **data, size_t *len);
+int decoder_error (decoder_t *decoder);
+void stop_decoder (decoder_t *decoder);
+
+#endif
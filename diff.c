@@ -0,0 +1,273 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "data.h"
+#include "diff.h"
+#include "source.h"
+#include "utils.h"
+
+/*
+ * Baseline fingerprints or identities, with how many baseline
+ * vulnerabilities have them that were not matched yet, and the first
+ * of them.
+ */
+typedef struct {
+  bool used;
+  uint64_t fingerprint;
+  size_t count;
+  size_t first;
+} fingerprint_slot_t;
+
+static uint64_t
+hash_string (uint64_t hash, const char *string)
+{
+  if (string)
+    hash = extend_hash (hash, string, strlen (string));
+
+  // separator, so that fields can't run into each other.
+  return extend_hash (hash, "", 1);
+}
+
+/*
+ * A vulnerability to identify against a baseline: `key` stands for its
+ * rule and file.
+ */
+typedef struct {
+  uint64_t key;
+  size_t line;
+  size_t index;
+} occurrence_t;
+
+/*
+ * Identify `vuln` by its rule, its file and the code it points to, in
+ * the source tree as it is now.
+ *
+ * The code line is hashed without whitespace, so that a finding is
+ * still recognized when lines around it are added or removed, or when
+ * it's reindented. When the source file can't be read, the line
+ * number is used instead.
+ *
+ * This only makes sense for two versions of a report of the same tree,
+ * like in watch mode: an older report, like a baseline, found its
+ * vulnerabilities in code which is not there anymore.
+ */
+static uint64_t
+fingerprint (vulnerability_t *vuln)
+{
+  uint64_t hash = HASH_SEED;
+  hash = hash_string (hash, vuln->title);
+  hash = hash_string (hash, vuln->file);
+
+  const source_t *source = vuln->file ? get_source (vuln->file) : NULL;
+  const char *content = NULL;
+  size_t len = 0;
+
+  if (!source || !get_source_line (source, vuln->line, &content, &len))
+    return extend_hash (hash, (const char *) &vuln->line, sizeof (vuln->line));
+
+  for (size_t i = 0; i < len; i++)
+    if (!isspace ((unsigned char) content[i]))
+      hash = extend_hash (hash, content + i, 1);
+
+  return hash;
+}
+
+static int
+compare_occurrences (const void *a, const void *b)
+{
+  const occurrence_t *first = a;
+  const occurrence_t *second = b;
+
+  if (first->key != second->key)
+    return first->key < second->key ? -1 : 1;
+
+  if (first->line != second->line)
+    return first->line < second->line ? -1 : 1;
+
+  return first->index < second->index ? -1 : first->index > second->index;
+}
+
+/*
+ * Identify each of `vulnerabilities` without looking at code, since the
+ * report may be about another version of the tree: by its rule, its
+ * file and its category, and which occurrence of that rule in that
+ * file it is, from the top of the file.
+ *
+ * Lines around a finding can move, the identity stays as long as the
+ * order of findings of a rule in a file does.
+ *
+ * Returns an allocated array, with one identity per vulnerability.
+ */
+static uint64_t *
+identify_vulnerabilities (vulnerability_list_t *vulnerabilities)
+{
+  size_t count = vulnerabilities->count;
+  uint64_t *identities = xalloc ((count + 1) * sizeof (uint64_t));
+  occurrence_t *occurrences = xalloc ((count + 1) * sizeof (occurrence_t));
+
+  for (size_t i = 0; i < count; i++)
+    {
+      vulnerability_t *vuln = &vulnerabilities->items[i];
+      uint64_t key = hash_string (hash_string (HASH_SEED, vuln->title), vuln->file);
+      occurrences[i] = (occurrence_t) { key, vuln->line, i };
+    }
+
+  qsort (occurrences, count, sizeof (occurrence_t), compare_occurrences);
+
+  size_t occurrence = 0;
+  for (size_t i = 0; i < count; i++)
+    {
+      occurrence = i > 0 && occurrences[i].key == occurrences[i - 1].key ? occurrence + 1 : 0;
+
+      vulnerability_t *vuln = &vulnerabilities->items[occurrences[i].index];
+      uint64_t hash = hash_string (occurrences[i].key, vuln->category);
+      identities[occurrences[i].index] = extend_hash (hash, (const char *) &occurrence, sizeof (occurrence));
+    }
+
+  free (occurrences);
+  return identities;
+}
+
+static fingerprint_slot_t *
+find_slot (fingerprint_slot_t *table, size_t capacity, uint64_t fingerprint)
+{
+  size_t slot = fingerprint & (capacity - 1);
+  while (table[slot].used && table[slot].fingerprint != fingerprint)
+    slot = (slot + 1) & (capacity - 1);
+
+  return &table[slot];
+}
+
+/*
+ * Compare `current` vulnerabilities with `baseline` ones, and only
+ * keep in `current` the ones which are new.
+ *
+ * Vulnerabilities are compared by identities which don't depend on
+ * code, since the baseline was found in another version of the tree.
+ *
+ * This is a hash join on identities: baseline is loaded in a hash
+ * table, then each current vulnerability is looked up in it, so it's
+ * linear in the total number of vulnerabilities. An identity seen
+ * twice in baseline matches two current vulnerabilities.
+ *
+ * How many vulnerabilities are new, fixed or unchanged is set in `diff`.
+ */
+void
+keep_new_vulnerabilities (vulnerability_list_t *baseline, vulnerability_list_t *current, diff_t *diff)
+{
+  size_t capacity = 64;
+  while (capacity < baseline->count * 2)
+    capacity *= 2;
+
+  fingerprint_slot_t *table = xalloc (capacity * sizeof (*table));
+  uint64_t *baseline_identities = identify_vulnerabilities (baseline);
+  for (size_t i = 0; i < baseline->count; i++)
+    {
+      fingerprint_slot_t *slot = find_slot (table, capacity, baseline_identities[i]);
+      slot->used = true;
+      slot->fingerprint = baseline_identities[i];
+      slot->count++;
+    }
+
+  uint64_t *identities = identify_vulnerabilities (current);
+
+  memset (diff, 0, sizeof (*diff));
+  size_t kept = 0;
+
+  for (size_t i = 0; i < current->count; i++)
+    {
+      fingerprint_slot_t *slot = find_slot (table, capacity, identities[i]);
+      if (slot->count > 0)
+        {
+          slot->count--;
+          diff->unchanged_count++;
+          continue;
+        }
+
+      current->items[kept++] = current->items[i];
+    }
+
+  memset (current->items + kept, 0, (current->count - kept) * sizeof (vulnerability_t));
+  current->count = kept;
+  diff->new_count = kept;
+  diff->fixed_count = baseline->count - diff->unchanged_count;
+
+  free (identities);
+  free (baseline_identities);
+  free (table);
+}
+
+/*
+ * Fingerprint each of `vulnerabilities`, to recognize them later in
+ * another version of the report with `match_vulnerabilities()`.
+ *
+ * Returns an allocated array, with one fingerprint per vulnerability.
+ */
+uint64_t *
+fingerprint_vulnerabilities (vulnerability_list_t *vulnerabilities)
+{
+  uint64_t *fingerprints = xalloc ((vulnerabilities->count + 1) * sizeof (uint64_t));
+  for (size_t i = 0; i < vulnerabilities->count; i++)
+    fingerprints[i] = fingerprint (&vulnerabilities->items[i]);
+
+  return fingerprints;
+}
+
+/*
+ * Find which `old` vulnerability each `fresh` one is, from their
+ * fingerprints: `matches[i]` is set to the index in `old` of fresh
+ * vulnerability `i`, or SIZE_MAX if it's new. Vulnerabilities sharing
+ * a fingerprint are matched in order.
+ *
+ * Like `keep_new_vulnerabilities()`, this is a hash join, linear in the
+ * total number of vulnerabilities. How many vulnerabilities are new,
+ * fixed or unchanged is set in `diff`.
+ */
+void
+match_vulnerabilities (const uint64_t *old, size_t old_count, const uint64_t *fresh, size_t fresh_count, size_t *matches, diff_t *diff)
+{
+  size_t capacity = 64;
+  while (capacity < old_count * 2)
+    capacity *= 2;
+
+  fingerprint_slot_t *table = xalloc (capacity * sizeof (*table));
+  size_t *next = xalloc ((old_count + 1) * sizeof (size_t));
+
+  // chain old vulnerabilities sharing a fingerprint, first one first.
+  for (size_t i = old_count; i-- > 0;)
+    {
+      fingerprint_slot_t *slot = find_slot (table, capacity, old[i]);
+      next[i] = slot->count > 0 ? slot->first : SIZE_MAX;
+      slot->used = true;
+      slot->fingerprint = old[i];
+      slot->first = i;
+      slot->count++;
+    }
+
+  memset (diff, 0, sizeof (*diff));
+
+  for (size_t i = 0; i < fresh_count; i++)
+    {
+      fingerprint_slot_t *slot = find_slot (table, capacity, fresh[i]);
+      if (slot->count == 0)
+        {
+          matches[i] = SIZE_MAX;
+          diff->new_count++;
+          continue;
+        }
+
+      matches[i] = slot->first;
+      slot->first = next[slot->first];
+      slot->count--;
+      diff->unchanged_count++;
+    }
+
+  diff->fixed_count = old_count - diff->unchanged_count;
+
+  free (next);
+  free (table);
+}
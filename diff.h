@@ -0,0 +1,14 @@
+#ifndef _DIFF_H_
+#define _DIFF_H_
+
+typedef struct {
+  size_t new_count;
+  size_t fixed_count;
+  size_t unchanged_count;
+} diff_t;
+
+void keep_new_vulnerabilities (vulnerability_list_t *baseline, vulnerability_list_t *current, diff_t *diff);
+uint64_t *fingerprint_vulnerabilities (vulnerability_list_t *vulnerabilities);
+void match_vulnerabilities (const uint64_t *old, size_t old_count, const uint64_t *fresh, size_t fresh_count, size_t *matches, diff_t *diff);
+
+#endif
@@ -0,0 +1,200 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "data.h"
+#include "group.h"
+#include "utils.h"
+
+/*
+ * Find the part of `vuln` it's grouped by with `mode`.
+ */
+static void
+group_key (vulnerability_t *vuln, int mode, const char **key, size_t *len)
+{
+  const char *value = vuln->file;
+  if (mode == GROUP_CATEGORY)
+    value = vuln->category;
+  else if (mode == GROUP_ANALYZER)
+    value = vuln->analyzer;
+
+  if (!value || !*value)
+    value = "(none)";
+
+  *key = value;
+  *len = strlen (value);
+
+  if (mode == GROUP_DIRECTORY)
+    {
+      const char *slash = strrchr (value, '/');
+      if (slash)
+        *len = slash - value + 1;
+      else
+        {
+          *key = "./";
+          *len = 2;
+        }
+    }
+}
+
+static int
+compare_groups (const void *a, const void *b)
+{
+  return strcmp (((const group_t *) a)->key, ((const group_t *) b)->key);
+}
+
+/*
+ * Group vulnerabilities by category, file, directory or analyzer,
+ * depending on `mode`, sorted by key.
+ *
+ * Groups are aggregated in a single pass over vulnerabilities using a
+ * hash table, then members are laid out contiguously, in `order`, or
+ * in report order if it's NULL.
+ */
+void
+group_vulnerabilities (vulnerability_list_t *vulnerabilities, int mode, const size_t *order, group_list_t *groups)
+{
+  memset (groups, 0, sizeof (*groups));
+  groups->mode = mode;
+  if (mode == GROUP_NONE)
+    return;
+
+  size_t capacity = 64;
+  while (capacity < vulnerabilities->count * 2)
+    capacity *= 2;
+
+  size_t *table = xalloc (capacity * sizeof (size_t));
+  size_t items_capacity = 0;
+  groups->group_of = xalloc ((vulnerabilities->count + 1) * sizeof (size_t));
+
+  for (size_t i = 0; i < vulnerabilities->count; i++)
+    {
+      const char *key = NULL;
+      size_t len = 0;
+      group_key (&vulnerabilities->items[i], mode, &key, &len);
+
+      // slots hold group index + 1, so that 0 means empty.
+      size_t slot = hash_bytes (key, len) & (capacity - 1);
+      while (table[slot])
+        {
+          group_t *group = &groups->items[table[slot] - 1];
+          if (strncmp (group->key, key, len) == 0 && group->key[len] == 0)
+            break;
+
+          slot = (slot + 1) & (capacity - 1);
+        }
+
+      if (!table[slot])
+        {
+          groups->items = xgrow (groups->items, sizeof (group_t), groups->count + 1, &items_capacity);
+          groups->items[groups->count].key = strndup (key, len);
+          table[slot] = ++groups->count;
+        }
+
+      groups->items[table[slot] - 1].count++;
+      groups->group_of[i] = table[slot] - 1;
+    }
+
+  free (table);
+
+  // sorting moves groups around, remember where each one went.
+  size_t *moved = xalloc ((groups->count + 1) * sizeof (size_t));
+  for (size_t i = 0; i < groups->count; i++)
+    groups->items[i].members = moved + i;
+
+  qsort (groups->items, groups->count, sizeof (group_t), compare_groups);
+
+  for (size_t i = 0; i < groups->count; i++)
+    *groups->items[i].members = i;
+
+  groups->members = xalloc ((vulnerabilities->count + 1) * sizeof (size_t));
+  size_t offset = 0;
+  for (size_t i = 0; i < groups->count; i++)
+    {
+      groups->items[i].members = groups->members + offset;
+      groups->items[i].visible_count = groups->items[i].count;
+      offset += groups->items[i].count;
+      groups->items[i].count = 0;
+    }
+
+  for (size_t i = 0; i < vulnerabilities->count; i++)
+    {
+      size_t index = order ? order[i] : i;
+      group_t *group = &groups->items[moved[groups->group_of[index]]];
+      groups->group_of[index] = group - groups->items;
+      group->members[group->count++] = index;
+    }
+
+  free (moved);
+  groups->visible = xalloc ((vulnerabilities->count + 1) * sizeof (size_t));
+}
+
+/*
+ * Restrict groups to vulnerabilities in `view`, updating their
+ * visible counts. When `view` is NULL, all vulnerabilities are
+ * visible again.
+ *
+ * This only goes through `view`, not through all vulnerabilities.
+ */
+void
+filter_groups (group_list_t *groups, const size_t *view, size_t view_count)
+{
+  if (groups->mode == GROUP_NONE)
+    return;
+
+  groups->filtered = view != NULL;
+  groups->stamp++;
+
+  for (size_t i = 0; i < groups->count; i++)
+    groups->items[i].visible_count = view ? 0 : groups->items[i].count;
+
+  if (!view)
+    return;
+
+  for (size_t i = 0; i < view_count; i++)
+    {
+      groups->visible[view[i]] = groups->stamp;
+      groups->items[groups->group_of[view[i]]].visible_count++;
+    }
+}
+
+/*
+ * Tell if vulnerability at `index` passes the current filter.
+ */
+bool
+is_visible (group_list_t *groups, size_t index)
+{
+  return !groups->filtered || groups->visible[index] == groups->stamp;
+}
+
+const char *
+group_mode_name (int mode)
+{
+  switch (mode)
+    {
+      case GROUP_CATEGORY: return "category";
+      case GROUP_FILE: return "file";
+      case GROUP_DIRECTORY: return "directory";
+      case GROUP_ANALYZER: return "analyzer";
+    }
+
+  return "none";
+}
+
+/*
+ * Free memory held by groups.
+ */
+void
+free_groups (group_list_t *groups)
+{
+  for (size_t i = 0; i < groups->count; i++)
+    free (groups->items[i].key);
+
+  if (groups->items) free (groups->items);
+  if (groups->members) free (groups->members);
+  if (groups->group_of) free (groups->group_of);
+  if (groups->visible) free (groups->visible);
+  memset (groups, 0, sizeof (*groups));
+}
@@ -0,0 +1,38 @@
+#ifndef _GROUP_H_
+#define _GROUP_H_
+
+enum {
+  GROUP_NONE,
+  GROUP_CATEGORY,
+  GROUP_FILE,
+  GROUP_DIRECTORY,
+  GROUP_ANALYZER,
+  GROUP_MODES_COUNT,
+};
+
+typedef struct {
+  char *key;
+  size_t *members;
+  size_t count;
+  size_t visible_count;
+  bool expanded;
+} group_t;
+
+typedef struct {
+  int mode;
+  group_t *items;
+  size_t count;
+  size_t *members;
+  size_t *group_of;
+  size_t *visible;
+  size_t stamp;
+  bool filtered;
+} group_list_t;
+
+void group_vulnerabilities (vulnerability_list_t *vulnerabilities, int mode, const size_t *order, group_list_t *groups);
+void filter_groups (group_list_t *groups, const size_t *view, size_t view_count);
+bool is_visible (group_list_t *groups, size_t index);
+const char *group_mode_name (int mode);
+void free_groups (group_list_t *groups);
+
+#endif
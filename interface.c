@@ -1,20 +1,101 @@
 #include <locale.h>
 #include <ncurses.h>
-#include <menu.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
+#include "arena.h"
 #include "data.h"
+#include "group.h"
+#include "source.h"
 #include "reflow.h"
+#include "layout.h"
+#include "search.h"
+#include "snippet.h"
+#include "sort.h"
+#include "stats.h"
 #include "utils.h"
+#include "watch.h"
+
+/*
+ * How often we check if the snippet of current report arrived, in
+ * milliseconds.
+ */
+#define SNIPPET_POLL_DELAY 50
+
+#define HELP_TEXT "Press q to quit, J/K/tab/S-tab to navigate reports, g/G/PgUp/PgDn/: to jump, / to search, o to group, O to sort, space to expand, s to show timings, j/k/DOWN/UP to scroll down/up the report"
+
+/*
+ * A row of the list when vulnerabilities are grouped: either a group
+ * header or one of its members.
+ */
+typedef struct {
+  bool is_group;
+  size_t index;
+} row_t;
 
 WINDOW *list_win = NULL;
-MENU *list_menu = NULL;
-ITEM **items = NULL;
+size_t list_top = 0;
+size_t current_row = 0;
+
+/*
+ * Vulnerabilities shown in the list, when it's filtered. When `view`
+ * is NULL, all vulnerabilities are shown.
+ */
+size_t *view = NULL;
+size_t view_count = 0;
+char search_query[MAX_QUERY_LENGTH] = {0};
+
+/*
+ * Order of the list, by `sort_key`: `order` is a permutation of
+ * vulnerabilities and `ranks` its inverse, both NULL in report order.
+ * Searches need `view` in increasing order, so it's copied in
+ * `sorted_view` in list order.
+ */
+int sort_key = SORT_REPORT;
+const size_t *order = NULL;
+const size_t *ranks = NULL;
+size_t *sorted_view = NULL;
+
+/*
+ * When grouping, list shows `rows` instead of vulnerabilities.
+ */
+group_list_t groups = {0};
+row_t *rows = NULL;
+size_t rows_count = 0;
+size_t rows_capacity = 0;
 
 WINDOW *report_win = NULL;
 
+/*
+ * Report of current vulnerability is drawn once in `report_pad`, and
+ * scrolling only changes which part of it is copied on screen. Only
+ * lines around the ones on screen are drawn, starting at line
+ * `report_pad_top` of the report, so long reports don't need huge pads.
+ */
+#define REPORT_PAD_MARGIN 512
+WINDOW *report_pad = NULL;
+size_t report_pad_index = SIZE_MAX;
+size_t report_pad_top = 0;
+bool report_pad_pending = false;
+
+/*
+ * Whether current report waits for its snippet.
+ */
+bool report_pending = false;
+
+/*
+ * Whether timings of the last render are shown in the status line.
+ */
+bool show_timings = false;
+
+/*
+ * Where keys come from when the report was read from standard input.
+ */
+FILE *terminal_input = NULL;
+
 static void
 create_list_window ()
 {
@@ -36,94 +117,703 @@ create_report_window ()
 }
 
 /*
- * Fill the left menu with the names of vulnerabilities found.
+ * How many vulnerabilities fit in the list.
+ */
+static size_t
+list_height ()
+{
+  return LINES > 3 ? LINES - 3 : 1;
+}
+
+/*
+ * How wide reports are.
+ */
+static size_t
+report_width ()
+{
+  return (COLS / 3 * 2) - 2;
+}
+
+/*
+ * How many rows are in the list.
+ */
+static size_t
+list_count (vulnerability_list_t *vulnerabilities)
+{
+  if (groups.mode != GROUP_NONE)
+    return rows_count;
+
+  return view ? view_count : vulnerabilities->count;
+}
+
+/*
+ * Index of the vulnerability at `row` in the list.
+ */
+static size_t
+list_index (size_t row)
+{
+  if (groups.mode != GROUP_NONE)
+    return rows[row].index;
+
+  if (view)
+    return sorted_view ? sorted_view[row] : view[row];
+
+  return order ? order[row] : row;
+}
+
+/*
+ * Group whose header is at `row` in the list, if any.
+ */
+static group_t *
+list_group (size_t row)
+{
+  if (groups.mode == GROUP_NONE || row >= rows_count || !rows[row].is_group)
+    return NULL;
+
+  return &groups.items[rows[row].index];
+}
+
+/*
+ * Find the row of vulnerability at `index`, or the one of its group
+ * header if it's collapsed.
+ *
+ * Returns 0 if it's not in the list.
+ */
+static size_t
+find_row (vulnerability_list_t *vulnerabilities, size_t index)
+{
+  size_t count = list_count (vulnerabilities);
+  size_t header = 0;
+
+  if (groups.mode == GROUP_NONE && !view)
+    return ranks ? ranks[index] : index;
+
+  for (size_t row = 0; row < count; row++)
+    {
+      group_t *group = list_group (row);
+      if (group && group == &groups.items[groups.group_of[index]])
+        header = row;
+      else if (!group && list_index (row) == index)
+        return row;
+    }
+
+  return header;
+}
+
+/*
+ * Insert visible members of `group` in the list at `row`.
  */
 static void
-populate_list (vulnerability_t vulnerabilities[MAX_VULNERABILITY_COUNT], size_t vulnerabilities_count)
+insert_members (group_t *group, size_t row)
 {
-  if (vulnerabilities_count == 0)
+  rows = xgrow (rows, sizeof (row_t), rows_count + group->visible_count, &rows_capacity);
+  memmove (rows + row + group->visible_count, rows + row, (rows_count - row) * sizeof (row_t));
+
+  for (size_t i = 0; i < group->count; i++)
+    if (is_visible (&groups, group->members[i]))
+      rows[row++] = (row_t) { false, group->members[i] };
+
+  rows_count += group->visible_count;
+}
+
+/*
+ * Build the rows of the list from groups, skipping the ones with no
+ * visible member.
+ */
+static void
+build_rows ()
+{
+  rows_count = 0;
+
+  for (size_t i = 0; i < groups.count; i++)
+    {
+      group_t *group = &groups.items[i];
+      if (group->visible_count == 0)
+        continue;
+
+      rows = xgrow (rows, sizeof (row_t), rows_count + 1, &rows_capacity);
+      rows[rows_count++] = (row_t) { true, i };
+
+      if (group->expanded)
+        insert_members (group, rows_count);
+    }
+}
+
+static int
+compare_ranks (const void *a, const void *b)
+{
+  size_t x = ranks[*(const size_t *) a];
+  size_t y = ranks[*(const size_t *) b];
+  return (x > y) - (x < y);
+}
+
+/*
+ * Put results of current search in list order, and restrict groups to
+ * them, if any.
+ */
+static void
+apply_view ()
+{
+  if (sorted_view) free (sorted_view);
+  sorted_view = NULL;
+
+  if (view && ranks)
+    {
+      sorted_view = xalloc ((view_count + 1) * sizeof (size_t));
+      memcpy (sorted_view, view, view_count * sizeof (size_t));
+      qsort (sorted_view, view_count, sizeof (size_t), compare_ranks);
+    }
+
+  if (groups.mode == GROUP_NONE)
     return;
 
-  items = xalloc ((vulnerabilities_count + 1) * sizeof (ITEM *));
-  for (size_t i = 0; i < vulnerabilities_count; i++)
-    items[i] = new_item (vulnerabilities[i].title, NULL);
+  filter_groups (&groups, view, view_count);
+  build_rows ();
+}
 
-  list_menu = new_menu (items);
-  set_menu_win (list_menu, list_win);
-  set_menu_back (list_menu, COLOR_PAIR (1));
+/*
+ * Print at most `width` bytes of the first line of `text`, without
+ * cutting a multibyte character.
+ */
+static void
+print_truncated (WINDOW *win, int y, int x, const char *text, size_t width)
+{
+  size_t len = strcspn (text, "\n");
+  if (len > width)
+    {
+      len = width;
+      while (len > 0 && (text[len] & 0xc0) == 0x80)
+        len--;
+    }
+
+  mvwaddnstr (win, y, x, text, len);
+}
+
+/*
+ * Draw the visible part of the list of vulnerabilities.
+ *
+ * Only the rows on screen are drawn, so this does not depend on how
+ * many vulnerabilities there are.
+ */
+static void
+draw_list (vulnerability_list_t *vulnerabilities)
+{
+  size_t height = list_height ();
+  size_t width = COLS / 3 - 2;
+  size_t count = list_count (vulnerabilities);
+
+  for (size_t i = 0; i < height; i++)
+    {
+      size_t row = list_top + i;
+      wmove (list_win, i + 1, 1);
+      for (size_t j = 0; j < width; j++)
+        waddch (list_win, ' ');
 
-  WINDOW *sub = derwin (list_win, LINES - 3, COLS / 3 - 2, 1, 1);
-  set_menu_sub (list_menu, sub);
-	set_menu_format (list_menu, LINES - 3, 1);
-  post_menu (list_menu);
+      if (row >= count)
+        continue;
+
+      if (row == current_row)
+        {
+          wattron (list_win, A_REVERSE);
+          mvwaddch (list_win, i + 1, 1, '-');
+        }
+
+      group_t *group = list_group (row);
+      if (group)
+        {
+          char *header = xsprintf ("[%c] %s (%zu)", group->expanded ? '-' : '+', group->key, group->visible_count);
+          print_truncated (list_win, i + 1, 2, header, width - 1);
+          free (header);
+        }
+      else if (groups.mode != GROUP_NONE)
+        print_truncated (list_win, i + 1, 4, vulnerabilities->items[list_index (row)].title, width > 3 ? width - 3 : 0);
+      else
+        print_truncated (list_win, i + 1, 2, vulnerabilities->items[list_index (row)].title, width - 1);
+
+      if (row == current_row)
+        wattroff (list_win, A_REVERSE);
+    }
 
   wrefresh (list_win);
-  refresh ();
 }
 
 /*
- * Display given vulnerability in main window.
+ * Show how long the last render took in the status line, stage by
+ * stage, along with how many lines the report has.
  */
-static int
-show_report (vulnerability_t *vulnerability, size_t y)
+static void
+show_render_timings (size_t lines_count)
 {
-  int err = 0;
+  char layout[32], reflow[32], snippet[32], render[32];
+  format_duration (last_duration (STAGE_LAYOUT), layout, sizeof (layout));
+  format_duration (last_duration (STAGE_REFLOW), reflow, sizeof (reflow));
+  format_duration (last_duration (STAGE_SNIPPET), snippet, sizeof (snippet));
+  format_duration (last_duration (STAGE_RENDER), render, sizeof (render));
 
-  wclear (report_win);
-  size_t max_width = (COLS / 3 * 2) - 2;
-  size_t max_height = LINES - 2;
-  line_t lines[MAX_LINES] = {0};
-  size_t line_count = 0;
+  move (LINES - 1, 0);
+  clrtoeol ();
+  mvprintw (LINES - 1, 1, "layout %s (last reflow %s, last snippet %s), render %s, %zu lines", layout, reflow, snippet, render, lines_count);
+  refresh ();
+}
 
-  char *err_msg = NULL;
-  err = reflow (max_width, vulnerability, lines, &line_count, &err_msg);
-  if (err)
+/*
+ * Draw `height` lines of `lines` in report pad, starting at line `top`.
+ */
+static void
+draw_report_pad (const line_list_t *lines, size_t top, size_t width, size_t height)
+{
+  if (!report_pad)
     {
-      mvwprintw (report_win, 1, 1, "%s", err_msg);
-      wrefresh (report_win);
-      fprintf (stderr, "interface.c : show_report() : can't format lines.\n");
-      goto cleanup;
+      report_pad = newpad (height, width);
+      wattron (report_pad, COLOR_PAIR (1));
     }
+  else
+    wresize (report_pad, height, width);
 
-  if (y >= line_count - 2)
-    y = line_count - 2;
+  werase (report_pad);
 
-  for (size_t i = 0; i < max_height && i + y < line_count; i++)
+  for (size_t i = 0; i < height && i + top < lines->count; i++)
     {
-      if (lines[i + y].heading)
+      const line_t *line = &lines->items[i + top];
+      if (line->flags & LINE_HEADING)
         {
-          wattron (report_win, COLOR_PAIR (2));
-          wattron (report_win, A_BOLD);
+          wattron (report_pad, COLOR_PAIR (2));
+          wattron (report_pad, A_BOLD);
         }
 
-      mvwprintw (report_win, i + 1, 1, "%s", lines[i + y].content);
+      mvwaddnstr (report_pad, i, 0, lines->text + line->offset, line->length);
 
-      if (lines[i + y].heading)
+      if (line->flags & LINE_HEADING)
         {
-          wattroff (report_win, A_BOLD);
-          wattroff (report_win, COLOR_PAIR (2));
-          wattron (report_win, COLOR_PAIR (1));
+          wattroff (report_pad, A_BOLD);
+          wattroff (report_pad, COLOR_PAIR (2));
+          wattron (report_pad, COLOR_PAIR (1));
         }
     }
+}
+
+/*
+ * Display vulnerability at `index` in main window, starting at line `y`.
+ *
+ * The report is only drawn when another vulnerability is shown, or
+ * when scrolling goes past what's drawn. Otherwise, only the part of
+ * the pad on screen moves, and ncurses sends to the terminal only what
+ * changed, without clearing the screen or redrawing the box.
+ *
+ * The report is drawn again too once its snippet, which is loaded in
+ * background, arrives.
+ */
+static void
+show_report (vulnerability_list_t *vulnerabilities, size_t index, size_t y)
+{
+  size_t max_width = report_width ();
+  size_t max_height = LINES > 3 ? LINES - 3 : 1;
+  size_t pad_height = max_height + REPORT_PAD_MARGIN;
+  bool pending = false;
+  const line_list_t *lines = get_layout (vulnerabilities, index, max_width, &pending);
+  report_pending = pending;
+
+  if (y >= lines->count - 2)
+    y = lines->count - 2;
+
+  uint64_t timer = start_timer ();
+
+  if (index != report_pad_index || pending != report_pad_pending || y < report_pad_top || y + max_height > report_pad_top + pad_height)
+    {
+      report_pad_top = y > REPORT_PAD_MARGIN / 2 ? y - REPORT_PAD_MARGIN / 2 : 0;
+      report_pad_index = index;
+      report_pad_pending = pending;
+      draw_report_pad (lines, report_pad_top, max_width, pad_height);
+    }
+
+  prefresh (report_pad, y - report_pad_top, 0, 1, COLS / 3 + 2, max_height, COLS / 3 + 1 + max_width);
+  stop_timer (STAGE_RENDER, timer);
+
+  if (show_timings)
+    show_render_timings (lines->count);
+}
+
+/*
+ * Tell there's nothing to show in main window.
+ */
+static void
+show_empty_report ()
+{
+  report_pending = false;
+  werase (report_win);
+  mvwprintw (report_win, 1, 1, "No vulnerability found.");
+  box (report_win, 0, 0);
+  wrefresh (report_win);
+}
 
+/*
+ * Display a summary of `group` in main window.
+ */
+static void
+show_group (group_t *group)
+{
+  report_pending = false;
+  werase (report_win);
+  wattron (report_win, COLOR_PAIR (2));
+  wattron (report_win, A_BOLD);
+  mvwprintw (report_win, 1, 1, "Vulnerabilities by %s:", group_mode_name (groups.mode));
+  wattroff (report_win, A_BOLD);
+  wattroff (report_win, COLOR_PAIR (2));
+  wattron (report_win, COLOR_PAIR (1));
+  print_truncated (report_win, 2, 1, group->key, COLS / 3 * 2 - 2);
+
+  if (groups.filtered)
+    mvwprintw (report_win, 4, 1, "%zu matching vulnerabilities out of %zu.", group->visible_count, group->count);
+  else
+    mvwprintw (report_win, 4, 1, "%zu vulnerabilities.", group->count);
+
+  mvwprintw (report_win, 6, 1, "Press space to %s.", group->expanded ? "collapse" : "expand");
   box (report_win, 0, 0);
   wrefresh (report_win);
+}
+
+/*
+ * Lay out vulnerabilities around `row` in the list in background,
+ * nearest first, so that moving to them is instant.
+ */
+static void
+prefetch_neighbours (vulnerability_list_t *vulnerabilities, size_t row)
+{
+  size_t count = list_count (vulnerabilities);
+  size_t indexes[PREFETCH_DISTANCE * 2];
+  size_t indexes_count = 0;
+
+  for (size_t distance = 1; distance <= PREFETCH_DISTANCE; distance++)
+    {
+      if (row + distance < count && !list_group (row + distance))
+        indexes[indexes_count++] = list_index (row + distance);
 
-  cleanup:
-  for (size_t i = 0; i < line_count; i++)
-    free (lines[i].content);
+      if (row >= distance && !list_group (row - distance))
+        indexes[indexes_count++] = list_index (row - distance);
+    }
 
-  return err;
+  prefetch_layouts (indexes, indexes_count, report_width ());
 }
 
 /*
- * Get ncurses interface ready.
+ * Make vulnerability at `row` in the list the current one, scrolling
+ * the list if needed.
+ */
+static void
+select_row (vulnerability_list_t *vulnerabilities, size_t row, size_t *current_vulnerability, size_t *current_line)
+{
+  size_t count = list_count (vulnerabilities);
+  *current_line = 0;
+
+  if (count == 0)
+    {
+      current_row = 0;
+      list_top = 0;
+      draw_list (vulnerabilities);
+      show_empty_report ();
+      return;
+    }
+
+  if (row >= count)
+    row = count - 1;
+
+  size_t height = list_height ();
+  if (row < list_top)
+    list_top = row;
+  else if (row >= list_top + height)
+    list_top = row - height + 1;
+
+  current_row = row;
+  draw_list (vulnerabilities);
+
+  group_t *group = list_group (row);
+  if (group)
+    show_group (group);
+  else
+    {
+      *current_vulnerability = list_index (row);
+      show_report (vulnerabilities, *current_vulnerability, 0);
+    }
+
+  prefetch_neighbours (vulnerabilities, row);
+
+  move (LINES - 1, COLS - 1);
+}
+
+/*
+ * Expand or collapse the group at `row`, or the one of the
+ * vulnerability at `row`.
+ *
+ * Only the rows of that group are added or removed.
+ */
+static void
+toggle_group (vulnerability_list_t *vulnerabilities, size_t row, size_t *current_vulnerability, size_t *current_line)
+{
+  if (groups.mode == GROUP_NONE || row >= rows_count)
+    return;
+
+  // members always come right after their group header.
+  while (!rows[row].is_group)
+    row--;
+
+  group_t *group = list_group (row);
+  group->expanded = !group->expanded;
+
+  if (group->expanded)
+    insert_members (group, row + 1);
+  else
+    {
+      memmove (rows + row + 1, rows + row + 1 + group->visible_count, (rows_count - row - 1 - group->visible_count) * sizeof (row_t));
+      rows_count -= group->visible_count;
+    }
+
+  select_row (vulnerabilities, row, current_vulnerability, current_line);
+}
+
+/*
+ * Switch to next grouping mode, keeping current vulnerability
+ * selected.
+ */
+static void
+cycle_grouping (vulnerability_list_t *vulnerabilities, size_t *current_vulnerability, size_t *current_line)
+{
+  int mode = (groups.mode + 1) % GROUP_MODES_COUNT;
+  free_groups (&groups);
+  group_vulnerabilities (vulnerabilities, mode, order, &groups);
+  apply_view ();
+
+  list_top = 0;
+  select_row (vulnerabilities, vulnerabilities->count > 0 ? find_row (vulnerabilities, *current_vulnerability) : 0, current_vulnerability, current_line);
+
+  move (LINES - 1, 0);
+  clrtoeol ();
+  mvprintw (LINES - 1, 1, "Grouping by %s", group_mode_name (mode));
+  move (LINES - 1, COLS - 1);
+}
+
+/*
+ * Show the help text in the status line.
+ */
+static void
+show_help ()
+{
+  move (LINES - 1, 0);
+  clrtoeol ();
+  mvprintw (LINES - 1, 1, HELP_TEXT);
+}
+
+/*
+ * Filter the list as user types a search query in the status line.
+ *
+ * Each key refines the previous results when possible, rather than
+ * searching everything again. Enter keeps the filter, Escape removes it.
+ */
+static void
+search_interactively (vulnerability_list_t *vulnerabilities, size_t *current_vulnerability, size_t *current_line)
+{
+  size_t len = strlen (search_query);
+  if (!view)
+    view = xalloc ((vulnerabilities->count + 1) * sizeof (size_t));
+
+  while (true)
+    {
+      move (LINES - 1, 0);
+      clrtoeol ();
+      mvprintw (LINES - 1, 1, "Search: %s", search_query);
+      refresh ();
+
+      int key = getch ();
+      if (key == '\n' || key == KEY_ENTER)
+        break;
+
+      if (key == 27)
+        {
+          search_query[0] = 0;
+          len = 0;
+        }
+      else if (key == KEY_BACKSPACE || key == 127 || key == '\b')
+        {
+          if (len == 0)
+            continue;
+
+          search_query[--len] = 0;
+        }
+      else if (key >= 32 && key < 256 && len < MAX_QUERY_LENGTH - 1)
+        {
+          // previous results are a superset of new ones.
+          const size_t *within = len > 0 ? view : NULL;
+          search_query[len++] = key;
+          search_query[len] = 0;
+
+          view_count = search_vulnerabilities (vulnerabilities, search_query, within, view_count, view);
+          apply_view ();
+          select_row (vulnerabilities, 0, current_vulnerability, current_line);
+          continue;
+        }
+      else
+        continue;
+
+      if (len == 0)
+        break;
+
+      view_count = search_vulnerabilities (vulnerabilities, search_query, NULL, 0, view);
+      apply_view ();
+      select_row (vulnerabilities, 0, current_vulnerability, current_line);
+    }
+
+  if (len == 0)
+    {
+      // back to the full list, on the vulnerability that was selected.
+      free (view);
+      view = NULL;
+      view_count = 0;
+      apply_view ();
+
+      size_t row = vulnerabilities->count > 0 ? find_row (vulnerabilities, *current_vulnerability) : 0;
+      select_row (vulnerabilities, row, current_vulnerability, current_line);
+    }
+
+  show_help ();
+  move (LINES - 1, COLS - 1);
+}
+
+/*
+ * Tell if two versions of a vulnerability are the same, to the byte.
+ */
+static bool
+same_string (const char *a, const char *b)
+{
+  return a == b || (a && b && strcmp (a, b) == 0);
+}
+
+static bool
+same_vulnerability (const vulnerability_t *a, const vulnerability_t *b)
+{
+  return a->line == b->line
+    && a->severity == b->severity
+    && a->confidence == b->confidence
+    && same_string (a->analyzer, b->analyzer)
+    && same_string (a->category, b->category)
+    && same_string (a->title, b->title)
+    && same_string (a->description, b->description)
+    && same_string (a->solution, b->solution)
+    && same_string (a->file, b->file);
+}
+
+/*
+ * Group `vulnerabilities` the way they are now, keeping the groups
+ * which were expanded expanded.
+ */
+static void
+regroup (vulnerability_list_t *vulnerabilities)
+{
+  group_list_t regrouped = {0};
+  group_vulnerabilities (vulnerabilities, groups.mode, order, &regrouped);
+
+  // both are sorted by key.
+  for (size_t i = 0, j = 0; i < regrouped.count && j < groups.count;)
+    {
+      int order = strcmp (regrouped.items[i].key, groups.items[j].key);
+      if (order == 0)
+        regrouped.items[i++].expanded = groups.items[j++].expanded;
+      else if (order < 0)
+        i++;
+      else
+        j++;
+    }
+
+  free_groups (&groups);
+  groups = regrouped;
+}
+
+/*
+ * Switch to next sort order, keeping current vulnerability selected.
+ *
+ * Orders are computed once, so switching back to one is instant.
+ * Groups keep their order, their members follow the new one.
+ */
+static void
+cycle_sort (vulnerability_list_t *vulnerabilities, size_t *current_vulnerability, size_t *current_line)
+{
+  sort_key = (sort_key + 1) % SORT_KEYS_COUNT;
+  order = sort_order (vulnerabilities, sort_key);
+  ranks = sort_ranks (vulnerabilities, sort_key);
+
+  if (groups.mode != GROUP_NONE)
+    regroup (vulnerabilities);
+
+  apply_view ();
+
+  bool on_vulnerability = list_count (vulnerabilities) > 0 && !list_group (current_row);
+  size_t row = on_vulnerability ? find_row (vulnerabilities, *current_vulnerability) : current_row;
+  list_top = 0;
+  select_row (vulnerabilities, row, current_vulnerability, current_line);
+
+  move (LINES - 1, 0);
+  clrtoeol ();
+  mvprintw (LINES - 1, 1, "Sorting by %s", sort_key_name (sort_key));
+  move (LINES - 1, COLS - 1);
+}
+
+/*
+ * Ask for a report number in the status line.
+ *
+ * Returns false if user cancelled.
+ */
+static bool
+prompt_number (const char *prompt, size_t *number)
+{
+  char input[21] = {0};
+  size_t len = 0;
+  bool validated = false;
+
+  while (true)
+    {
+      move (LINES - 1, 0);
+      clrtoeol ();
+      mvprintw (LINES - 1, 1, "%s%s", prompt, input);
+      refresh ();
+
+      int key = getch ();
+      if (key == '\n' || key == KEY_ENTER)
+        {
+          validated = len > 0;
+          break;
+        }
+
+      if (key == 27)
+        break;
+
+      if ((key == KEY_BACKSPACE || key == 127 || key == '\b') && len > 0)
+        input[--len] = 0;
+      else if (key >= '0' && key <= '9' && len < sizeof (input) - 1)
+        input[len++] = key;
+    }
+
+  show_help ();
+
+  if (validated)
+    *number = strtoull (input, NULL, 10);
+
+  return validated;
+}
+
+/*
+ * Get ncurses interface ready, with the list sorted by `sort`.
+ * `current_vulnerability` is set to the first one of the list.
  */
 void
-init_ncurses (vulnerability_t vulnerabilities[MAX_VULNERABILITY_COUNT], size_t vulnerabilities_count)
+init_ncurses (vulnerability_list_t *vulnerabilities, int sort, size_t *current_vulnerability)
 {
   setlocale(LC_CTYPE, "");
-  initscr ();
+
+  // when the report is piped in, keys come from the terminal.
+  if (!isatty (STDIN_FILENO))
+    terminal_input = fopen ("/dev/tty", "r");
+
+  if (!terminal_input || !newterm (NULL, stdout, terminal_input))
+    initscr ();
+
   cbreak ();
   keypad (stdscr, true);
   noecho ();
@@ -135,17 +825,25 @@ init_ncurses (vulnerability_t vulnerabilities[MAX_VULNERABILITY_COUNT], size_t v
 
   create_list_window ();
   create_report_window ();
-  mvprintw (LINES - 1, 1, "Press q to quit, J/K/tab/S-tab to navigate reports, j/k/DOWN/UP to scroll down/up the report");
-  
-  populate_list (vulnerabilities, vulnerabilities_count);
+  show_help ();
 
-  if (vulnerabilities_count > 0)
-    show_report (&vulnerabilities[0], 0);
-  else
+  sort_key = sort;
+  order = sort_order (vulnerabilities, sort_key);
+  ranks = sort_ranks (vulnerabilities, sort_key);
+
+  draw_list (vulnerabilities);
+  start_snippet_loader (vulnerabilities);
+
+  if (vulnerabilities->count > 0)
     {
-      mvwprintw (report_win, 1, 1, "No vulnerability found.");
-      wrefresh (report_win);
+      *current_vulnerability = list_index (0);
+      show_report (vulnerabilities, *current_vulnerability, 0);
+      prefetch_neighbours (vulnerabilities, 0);
     }
+  else
+    show_empty_report ();
+
+  build_search_index (vulnerabilities);
 
   move (LINES - 1, COLS - 1);
   refresh ();
@@ -157,9 +855,17 @@ init_ncurses (vulnerability_t vulnerabilities[MAX_VULNERABILITY_COUNT], size_t v
  * Returns true if the program needs to quit.
  */
 bool
-handle_key (vulnerability_t vulnerabilities[MAX_VULNERABILITY_COUNT], size_t vulnerabilities_count, size_t *current_vulnerability, size_t *current_line)
+handle_key (vulnerability_list_t *vulnerabilities, size_t *current_vulnerability, size_t *current_line)
 {
+  // don't wait for a key forever while a snippet is on its way, or
+  // while watching for changes.
+  timeout (report_pending ? SNIPPET_POLL_DELAY : is_watching () ? WATCH_POLL_DELAY : -1);
   int key = getch ();
+  timeout (-1);
+
+  size_t height = list_height ();
+  size_t count = list_count (vulnerabilities);
+  size_t number = 0;
 
 
   switch (key)
@@ -167,24 +873,32 @@ handle_key (vulnerability_t vulnerabilities[MAX_VULNERABILITY_COUNT], size_t vul
       case 'q':
         return true;
 
+      case ERR:
+        if (report_pending)
+          {
+            show_report (vulnerabilities, *current_vulnerability, *current_line);
+            move (LINES - 1, COLS - 1);
+          }
+        break;
+
       case 'j':
       case KEY_DOWN:
-        if (vulnerabilities_count > 0)
+        if (count > 0 && !list_group (current_row))
           {
             (*current_line)++;
-            show_report (&vulnerabilities[*current_vulnerability], *current_line);
+            show_report (vulnerabilities, *current_vulnerability, *current_line);
             move (LINES - 1, COLS - 1);
           }
         break;
 
       case 'k':
       case KEY_UP:
-        if (vulnerabilities_count > 0)
+        if (count > 0 && !list_group (current_row))
           {
             if (*current_line > 0)
               {
                 (*current_line)--;
-                show_report (&vulnerabilities[*current_vulnerability], *current_line);
+                show_report (vulnerabilities, *current_vulnerability, *current_line);
                 move (LINES - 1, COLS - 1);
               }
           }
@@ -192,55 +906,227 @@ handle_key (vulnerability_t vulnerabilities[MAX_VULNERABILITY_COUNT], size_t vul
 
       case 'J':
       case '\t':
-        if (vulnerabilities_count > 0)
-          if (*current_vulnerability < vulnerabilities_count - 1)
-            {
-              (*current_vulnerability)++;
-              *current_line = 0;
-              menu_driver (list_menu, REQ_DOWN_ITEM);
-              wrefresh (list_win);
-              show_report (&vulnerabilities[*current_vulnerability], *current_line);
-              move (LINES - 1, COLS - 1);
-            }
+        if (count > 0)
+          if (current_row < count - 1)
+            select_row (vulnerabilities, current_row + 1, current_vulnerability, current_line);
 
         break;
 
       case 'K':
       case KEY_BTAB:
-        if (vulnerabilities_count > 0)
-          if (*current_vulnerability > 0)
-            {
-              (*current_vulnerability)--;
-              *current_line = 0;
-              menu_driver (list_menu, REQ_UP_ITEM);
-              wrefresh (list_win);
-              show_report (&vulnerabilities[*current_vulnerability], *current_line);
-              move (LINES - 1, COLS - 1);
-            }
+        if (count > 0)
+          if (current_row > 0)
+            select_row (vulnerabilities, current_row - 1, current_vulnerability, current_line);
+
+        break;
 
+      case 'g':
+      case KEY_HOME:
+        select_row (vulnerabilities, 0, current_vulnerability, current_line);
+        break;
+
+      case 'G':
+      case KEY_END:
+        if (count > 0)
+          select_row (vulnerabilities, count - 1, current_vulnerability, current_line);
+
+        break;
+
+      case KEY_NPAGE:
+        select_row (vulnerabilities, current_row + height, current_vulnerability, current_line);
+        break;
+
+      case KEY_PPAGE:
+        select_row (vulnerabilities, current_row > height ? current_row - height : 0, current_vulnerability, current_line);
+        break;
+
+      case ':':
+        if (prompt_number ("Go to report: ", &number) && number > 0)
+          select_row (vulnerabilities, number - 1, current_vulnerability, current_line);
+
+        move (LINES - 1, COLS - 1);
+        break;
+
+      case '/':
+        search_interactively (vulnerabilities, current_vulnerability, current_line);
+        break;
+
+      case 'o':
+        cycle_grouping (vulnerabilities, current_vulnerability, current_line);
+        break;
+
+      case 'O':
+        cycle_sort (vulnerabilities, current_vulnerability, current_line);
+        break;
+
+      case ' ':
+        toggle_group (vulnerabilities, current_row, current_vulnerability, current_line);
+        break;
+
+      case 's':
+        show_timings = !show_timings;
+        stats_enabled |= show_timings;
+
+        if (show_timings && count > 0 && !list_group (current_row))
+          show_report (vulnerabilities, *current_vulnerability, *current_line);
+        else
+          show_help ();
+
+        move (LINES - 1, COLS - 1);
         break;
     }
 
   return false;
 }
 
+/*
+ * Show `message` in the status line.
+ */
 void
-cleanup_ncurses ()
+show_message (const char *message)
 {
-  endwin ();
-  if (list_menu) free_menu (list_menu);
+  move (LINES - 1, 0);
+  clrtoeol ();
+  mvprintw (LINES - 1, 1, "%s", message);
+  move (LINES - 1, COLS - 1);
+  refresh ();
+}
+
+/*
+ * Paint the whole screen again, after something else wrote on the
+ * terminal.
+ */
+void
+redraw_screen ()
+{
+  clearok (curscr, TRUE);
+  wrefresh (curscr);
+}
+
+/*
+ * Show new content of source file at `path` in snippets, because it
+ * changed. Only layouts and snippets of vulnerabilities in that file
+ * are made again.
+ */
+void
+refresh_source (vulnerability_list_t *vulnerabilities, const char *path, size_t *current_vulnerability, size_t *current_line)
+{
+  if (!invalidate_source (path))
+    return;
+
+  forget_snippets (path);
+
+  // once loaders are stopped, nothing reads the previous version.
+  suspend_snippet_loader ();
+  free_retired_sources ();
+  resume_snippet_loader (NULL);
+  forget_layouts (vulnerabilities, path);
 
-  if (items)
+  if (list_count (vulnerabilities) == 0 || list_group (current_row))
+    return;
+
+  const char *file = vulnerabilities->items[*current_vulnerability].file;
+  if (file && strcmp (file, path) == 0)
     {
-      for (size_t i = 0; i < MAX_VULNERABILITY_COUNT; i++)
-        {
-          ITEM *item = items[i];
-          if (!item)
-            break;
+      report_pad_index = SIZE_MAX;
+      show_report (vulnerabilities, *current_vulnerability, *current_line);
+    }
+
+  prefetch_neighbours (vulnerabilities, current_row);
+  move (LINES - 1, COLS - 1);
+}
 
-          free_item (item);
+/*
+ * Replace `vulnerabilities` with `fresh`, a new version of the report,
+ * and empty `fresh`.
+ *
+ * `matches[i]` is the index in `vulnerabilities` of fresh vulnerability
+ * `i`, or SIZE_MAX if it's new. Layouts and snippets are only made
+ * again for vulnerabilities which changed. Selected vulnerability stays
+ * selected, and search and expanded groups are kept.
+ */
+void
+update_vulnerabilities (vulnerability_list_t *vulnerabilities, vulnerability_list_t *fresh, const size_t *matches, size_t *current_vulnerability, size_t *current_line)
+{
+  size_t *kept = xalloc ((fresh->count + 1) * sizeof (size_t));
+  size_t *moved = xalloc ((vulnerabilities->count + 1) * sizeof (size_t));
+  bool on_vulnerability = list_count (vulnerabilities) > 0 && !list_group (current_row);
+  size_t selected = SIZE_MAX;
+
+  for (size_t i = 0; i < vulnerabilities->count; i++)
+    moved[i] = SIZE_MAX;
+
+  for (size_t i = 0; i < fresh->count; i++)
+    {
+      kept[i] = SIZE_MAX;
+      if (matches[i] == SIZE_MAX)
+        continue;
+
+      if (on_vulnerability && matches[i] == *current_vulnerability)
+        selected = i;
+
+      if (same_vulnerability (&vulnerabilities->items[matches[i]], &fresh->items[i]))
+        {
+          kept[i] = matches[i];
+          moved[matches[i]] = i;
         }
+    }
+
+  // nothing may use previous version anymore.
+  free_search_index ();
+  suspend_snippet_loader ();
+  remap_layouts (moved);
+
+  free_data (vulnerabilities);
+  *vulnerabilities = *fresh;
+  memset (fresh, 0, sizeof (*fresh));
+
+  resume_snippet_loader (kept);
+  build_search_index (vulnerabilities);
+
+  forget_sort_orders ();
+  order = sort_order (vulnerabilities, sort_key);
+  ranks = sort_ranks (vulnerabilities, sort_key);
+  regroup (vulnerabilities);
+
+  if (view)
+    {
+      free (view);
+      view = xalloc ((vulnerabilities->count + 1) * sizeof (size_t));
+      view_count = search_vulnerabilities (vulnerabilities, search_query, NULL, 0, view);
+    }
+
+  apply_view ();
 
-      free (items);
+  size_t line = *current_line;
+  report_pad_index = SIZE_MAX;
+  select_row (vulnerabilities, selected != SIZE_MAX ? find_row (vulnerabilities, selected) : current_row, current_vulnerability, current_line);
+
+  if (selected != SIZE_MAX && *current_vulnerability == selected && !list_group (current_row) && line > 0)
+    {
+      *current_line = line;
+      show_report (vulnerabilities, selected, line);
+      move (LINES - 1, COLS - 1);
     }
+
+  free (kept);
+  free (moved);
+}
+
+void
+cleanup_ncurses ()
+{
+  endwin ();
+  if (terminal_input) fclose (terminal_input);
+  free_layouts ();
+  stop_snippet_loader ();
+  free_sources ();
+  free_source_root ();
+  free_search_index ();
+  free_groups (&groups);
+  if (report_pad) delwin (report_pad);
+  forget_sort_orders ();
+  if (view) free (view);
+  if (sorted_view) free (sorted_view);
+  if (rows) free (rows);
 }
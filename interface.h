@@ -1,8 +1,12 @@
 #ifndef _INTERFACE_H_
 #define _INTERFACE_H_
 
-void init_ncurses (vulnerability_t vulnerabilities[MAX_VULNERABILITY_COUNT], size_t vulnerabilities_count);
-bool handle_key (vulnerability_t vulnerabilities[MAX_VULNERABILITY_COUNT], size_t vulnerabilities_count, size_t *current_vulnerability, size_t *current_line);
+void init_ncurses (vulnerability_list_t *vulnerabilities, int sort, size_t *current_vulnerability);
+bool handle_key (vulnerability_list_t *vulnerabilities, size_t *current_vulnerability, size_t *current_line);
+void show_message (const char *message);
+void redraw_screen ();
+void refresh_source (vulnerability_list_t *vulnerabilities, const char *path, size_t *current_vulnerability, size_t *current_line);
+void update_vulnerabilities (vulnerability_list_t *vulnerabilities, vulnerability_list_t *fresh, const size_t *matches, size_t *current_vulnerability, size_t *current_line);
 void cleanup_ncurses ();
 
 #endif
@@ -0,0 +1,150 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "arena.h"
+#include "data.h"
+#include "source.h"
+#include "reflow.h"
+#include "layout.h"
+#include "snippet.h"
+#include "stats.h"
+
+typedef struct {
+  bool used;
+  size_t index;
+  size_t max_width;
+  unsigned long last_use;
+  bool pending;
+  line_list_t lines;
+} layout_t;
+
+static layout_t layouts[LAYOUT_CACHE_SIZE] = {0};
+static unsigned long use_counter = 0;
+
+/*
+ * Get the reflowed lines of vulnerability at `index` for `max_width`.
+ *
+ * Layouts are cached, so scrolling through a report or coming back to
+ * it does not format it again. Only the LAYOUT_CACHE_SIZE most recently
+ * used layouts are kept.
+ *
+ * Snippets are looked for in background by the snippet loader. Until
+ * it's found, `pending` is set to true and the layout has a
+ * placeholder instead, which is replaced on a later call once the
+ * snippet is there. Layouts prefetched in background are used when
+ * they're ready.
+ *
+ * The returned lines belong to the cache, don't free them. They are
+ * valid until the next call.
+ */
+const line_list_t *
+get_layout (vulnerability_list_t *vulnerabilities, size_t index, size_t max_width, bool *pending)
+{
+  uint64_t timer = start_timer ();
+  const source_t *source = NULL;
+
+  layout_t *oldest = &layouts[0];
+  use_counter++;
+
+  for (size_t i = 0; i < LAYOUT_CACHE_SIZE; i++)
+    {
+      layout_t *layout = &layouts[i];
+      if (layout->used && layout->index == index && layout->max_width == max_width)
+        {
+          layout->last_use = use_counter;
+          if (layout->pending && get_snippet_source (index, &source))
+            {
+              clear_lines (&layout->lines);
+              reflow_with_snippet (max_width, &vulnerabilities->items[index], source, false, &layout->lines);
+              layout->pending = false;
+            }
+
+          *pending = layout->pending;
+          stop_timer (STAGE_LAYOUT, timer);
+          return &layout->lines;
+        }
+
+      if (!layout->used || (oldest->used && layout->last_use < oldest->last_use))
+        oldest = layout;
+    }
+
+  if (oldest->used)
+    free_lines (&oldest->lines);
+
+  oldest->used = true;
+  oldest->index = index;
+  oldest->max_width = max_width;
+  oldest->last_use = use_counter;
+  oldest->pending = false;
+  if (!take_prefetched_layout (index, max_width, &oldest->lines))
+    {
+      oldest->pending = !get_snippet_source (index, &source);
+      reflow_with_snippet (max_width, &vulnerabilities->items[index], source, oldest->pending, &oldest->lines);
+    }
+
+  *pending = oldest->pending;
+  stop_timer (STAGE_LAYOUT, timer);
+
+  return &oldest->lines;
+}
+
+/*
+ * Drop cached layouts of vulnerabilities in source file at `path`,
+ * because it changed.
+ */
+void
+forget_layouts (vulnerability_list_t *vulnerabilities, const char *path)
+{
+  for (size_t i = 0; i < LAYOUT_CACHE_SIZE; i++)
+    {
+      layout_t *layout = &layouts[i];
+      if (!layout->used)
+        continue;
+
+      const char *file = vulnerabilities->items[layout->index].file;
+      if (file && strcmp (file, path) == 0)
+        {
+          free_lines (&layout->lines);
+          memset (layout, 0, sizeof (*layout));
+        }
+    }
+}
+
+/*
+ * Follow vulnerabilities after they're replaced by a new version of
+ * the report. `moved[i]` is the new index of vulnerability which was
+ * at `i`, if it did not change, or SIZE_MAX, in which case its layout
+ * is dropped.
+ */
+void
+remap_layouts (const size_t *moved)
+{
+  for (size_t i = 0; i < LAYOUT_CACHE_SIZE; i++)
+    {
+      layout_t *layout = &layouts[i];
+      if (!layout->used)
+        continue;
+
+      if (moved[layout->index] == SIZE_MAX)
+        {
+          free_lines (&layout->lines);
+          memset (layout, 0, sizeof (*layout));
+        }
+      else
+        layout->index = moved[layout->index];
+    }
+}
+
+/*
+ * Free memory held by cached layouts.
+ */
+void
+free_layouts ()
+{
+  for (size_t i = 0; i < LAYOUT_CACHE_SIZE; i++)
+    if (layouts[i].used)
+      free_lines (&layouts[i].lines);
+
+  memset (layouts, 0, sizeof (layouts));
+}
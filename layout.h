@@ -0,0 +1,11 @@
+#ifndef _LAYOUT_H_
+#define _LAYOUT_H_
+
+#define LAYOUT_CACHE_SIZE 32
+
+const line_list_t *get_layout (vulnerability_list_t *vulnerabilities, size_t index, size_t max_width, bool *pending);
+void forget_layouts (vulnerability_list_t *vulnerabilities, const char *path);
+void remap_layouts (const size_t *moved);
+void free_layouts ();
+
+#endif
@@ -0,0 +1,294 @@
+#include <dirent.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "data.h"
+#include "loader.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "utils.h"
+
+#define MAX_LOADERS 16
+
+/*
+ * Paths of the reports to load, once directories given on command
+ * line are replaced by the reports they contain.
+ */
+typedef struct {
+  char **paths;
+  size_t count;
+  size_t capacity;
+} report_paths_t;
+
+/*
+ * Reports being loaded by several threads. Each thread takes the next
+ * report not taken yet, so a thread done with a small report moves to
+ * another one while big ones are still being parsed.
+ *
+ * Each report goes to its own list, so they're merged in the order
+ * they were given, whichever finishes first.
+ */
+typedef struct {
+  const report_paths_t *reports;
+  size_t next;
+  vulnerability_list_t *lists;
+  int *errors;
+} load_job_t;
+
+static const char *report_suffixes[] = { ".json", ".json.gz", ".json.zst" };
+
+/*
+ * Tell if file `name` looks like a report, when looking for reports in
+ * a directory.
+ */
+bool
+is_report_name (const char *name)
+{
+  if (name[0] == '.')
+    return false;
+
+  size_t len = strlen (name);
+  for (size_t i = 0; i < sizeof (report_suffixes) / sizeof (*report_suffixes); i++)
+    {
+      size_t suffix_len = strlen (report_suffixes[i]);
+      if (len > suffix_len && strcmp (name + len - suffix_len, report_suffixes[i]) == 0)
+        return true;
+    }
+
+  return false;
+}
+
+static int
+filter_reports (const struct dirent *entry)
+{
+  return is_report_name (entry->d_name);
+}
+
+static void
+add_report (report_paths_t *reports, char *path)
+{
+  reports->paths = xgrow (reports->paths, sizeof (char *), reports->count + 1, &reports->capacity);
+  reports->paths[reports->count++] = path;
+}
+
+/*
+ * Add reports in `directory` to `reports`, sorted by name. Only files
+ * whose name ends with .json, .json.gz or .json.zst are considered.
+ *
+ * Returns non-zero in case of error, or if there is none.
+ */
+static int
+list_directory (const char *directory, report_paths_t *reports)
+{
+  struct dirent **entries = NULL;
+  int count = scandir (directory, &entries, filter_reports, alphasort);
+  if (count < 0)
+    {
+      fprintf (stderr, "loader.c : list_directory() : can't read directory : %s\n", directory);
+      return 1;
+    }
+
+  size_t len = strlen (directory);
+  const char *separator = len > 0 && directory[len - 1] == '/' ? "" : "/";
+  size_t found = 0;
+
+  for (int i = 0; i < count; i++)
+    {
+      char *path = xsprintf ("%s%s%s", directory, separator, entries[i]->d_name);
+      struct stat info;
+      if (stat (path, &info) == 0 && S_ISREG (info.st_mode))
+        {
+          add_report (reports, path);
+          found++;
+        }
+      else
+        free (path);
+
+      free (entries[i]);
+    }
+
+  free (entries);
+
+  if (found == 0)
+    {
+      fprintf (stderr, "loader.c : list_directory() : no report found in directory : %s\n", directory);
+      return 1;
+    }
+
+  return 0;
+}
+
+/*
+ * Find the reports to load from command line `arguments`, which are
+ * either reports, directories of reports, or "-" for standard input.
+ *
+ * Paths are added to `reports`.
+ *
+ * Returns non-zero in case of error.
+ */
+static int
+list_reports (char **arguments, size_t count, report_paths_t *reports)
+{
+  for (size_t i = 0; i < count; i++)
+    {
+      struct stat info;
+      if (strcmp (arguments[i], "-") != 0 && stat (arguments[i], &info) == 0 && S_ISDIR (info.st_mode))
+        {
+          if (list_directory (arguments[i], reports))
+            return 1;
+        }
+      else
+        // missing files are reported when parsing them.
+        add_report (reports, strdup (arguments[i]));
+    }
+
+  return 0;
+}
+
+static void
+free_report_paths (report_paths_t *reports)
+{
+  for (size_t i = 0; i < reports->count; i++)
+    free (reports->paths[i]);
+
+  if (reports->paths) free (reports->paths);
+  memset (reports, 0, sizeof (*reports));
+}
+
+/*
+ * Load report at `uri`, from its snapshot if it has not changed since
+ * last time, or by parsing it, saving a snapshot for next time.
+ * Standard input can't be cached.
+ *
+ * Returns non-zero in case of error.
+ */
+static int
+load_report (const char *uri, vulnerability_list_t *vulnerabilities)
+{
+  snapshot_key_t key;
+  uint64_t timer = start_timer ();
+  bool cacheable = strcmp (uri, "-") != 0 && get_snapshot_key (uri, &key) == 0;
+  stop_timer (STAGE_SNAPSHOT_KEY, timer);
+
+  if (cacheable)
+    {
+      count_stat (COUNTER_BYTES_READ, key.size);
+
+      timer = start_timer ();
+      bool loaded = load_snapshot (uri, &key, vulnerabilities) == 0;
+      stop_timer (STAGE_LOAD_SNAPSHOT, timer);
+
+      if (loaded)
+        {
+          count_stat (COUNTER_BYTES_READ, vulnerabilities->mappings[0].size);
+          return 0;
+        }
+    }
+
+  int err = parse_data (uri, vulnerabilities);
+  if (!err && cacheable)
+    {
+      timer = start_timer ();
+      save_snapshot (uri, &key, vulnerabilities);
+      stop_timer (STAGE_SAVE_SNAPSHOT, timer);
+    }
+
+  return err;
+}
+
+static void *
+run_loader (void *data)
+{
+  load_job_t *job = data;
+
+  while (true)
+    {
+      size_t i = __atomic_fetch_add (&job->next, 1, __ATOMIC_RELAXED);
+      if (i >= job->reports->count)
+        break;
+
+      job->errors[i] = load_report (job->reports->paths[i], &job->lists[i]);
+    }
+
+  return NULL;
+}
+
+/*
+ * Load reports given on command line as `arguments`, which may be
+ * directories of reports, and append their vulnerabilities to
+ * `vulnerabilities` in the order reports were given. Each report is
+ * checked on its own, and its vulnerabilities are tagged with the
+ * analyzer which produced it.
+ *
+ * Reports are loaded at once, on as many threads as there are
+ * processors, so it takes about as long as the biggest report rather
+ * than the sum of all of them.
+ *
+ * Returns non-zero if any report can't be loaded, in which case none
+ * is added.
+ */
+int
+load_reports (char **arguments, size_t count, vulnerability_list_t *vulnerabilities)
+{
+  report_paths_t reports = {0};
+  int err = list_reports (arguments, count, &reports);
+  if (err)
+    {
+      free_report_paths (&reports);
+      return err;
+    }
+
+  load_job_t job = {
+    .reports = &reports,
+    .lists = xalloc ((reports.count + 1) * sizeof (vulnerability_list_t)),
+    .errors = xalloc ((reports.count + 1) * sizeof (int)),
+  };
+
+  long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  size_t threads_count = cpus > 1 ? cpus : 1;
+  if (threads_count > MAX_LOADERS)
+    threads_count = MAX_LOADERS;
+
+  if (threads_count > reports.count)
+    threads_count = reports.count;
+
+  pthread_t threads[MAX_LOADERS];
+  bool started[MAX_LOADERS] = {0};
+
+  // reports left by threads which could not start are taken by others.
+  for (size_t i = 1; i < threads_count; i++)
+    started[i] = pthread_create (&threads[i], NULL, run_loader, &job) == 0;
+
+  run_loader (&job);
+
+  for (size_t i = 1; i < threads_count; i++)
+    if (started[i])
+      pthread_join (threads[i], NULL);
+
+  for (size_t i = 0; i < reports.count; i++)
+    if (job.errors[i])
+      {
+        fprintf (stderr, "loader.c : load_reports() : can't load report : %s\n", reports.paths[i]);
+        err = 1;
+      }
+
+  for (size_t i = 0; i < reports.count; i++)
+    {
+      if (!err)
+        merge_data (vulnerabilities, &job.lists[i]);
+
+      free_data (&job.lists[i]);
+    }
+
+  free (job.lists);
+  free (job.errors);
+  free_report_paths (&reports);
+  return err;
+}
@@ -0,0 +1,10 @@
+#ifndef _LOADER_H_
+#define _LOADER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+bool is_report_name (const char *name);
+int load_reports (char **arguments, size_t count, vulnerability_list_t *vulnerabilities);
+
+#endif
@@ -1,63 +1,337 @@
+#include <getopt.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
 #include "data.h"
+#include "batch.h"
+#include "diff.h"
 #include "interface.h"
+#include "loader.h"
+#include "sort.h"
+#include "source.h"
+#include "stats.h"
+#include "utils.h"
+#include "watch.h"
+
+#define DEFAULT_BATCH_WIDTH 80
 
 static void
 usage (const char *progname)
 {
-  printf ("%s [-h|--help] <file> \n\
+  printf ("%s [-h|--help] [-b|--batch] [-w|--width <columns>] [-o|--output <file>] [-B|--baseline <file>] [-S|--sort <key>] [-r|--root <directory>] [-s|--stats] [-W|--watch] <file>... \n\
 \n\
 Brings a ncurses interface to inspect Gitlab's SAST reports. \n\
 \n\
-You must provide a path to a downloaded JSON report. \n\
-If you execute %s within the analyzed codebase's directory, \n\
-you will see snippets of the code related to each report. You \n\
-must be at the root of that directory for this to happen. \n\
-  ", progname, progname);
+You must provide paths to downloaded JSON reports, which may be \n\
+compressed with gzip or zstd, or - to read one from standard input. \n\
+Reports of several analyzers are shown together. A directory stands \n\
+for all the *.json, *.json.gz and *.json.zst reports it contains. \n\
+If you execute %s at the root of the analyzed codebase's \n\
+directory, or give it with --root, you will see snippets of the \n\
+code related to each report. \n\
+\n\
+Parsed reports are cached in $XDG_CACHE_HOME/sasty (by default, \n\
+~/.cache/sasty), so they open faster next time. \n\
+\n\
+Options: \n\
+  -b, --batch     don't start the interface, write all reports as \n\
+                  text instead (on standard output by default) \n\
+  -w, --width     width of text in batch mode (default: %d) \n\
+  -o, --output    write batch mode text to this file \n\
+  -B, --baseline  only show vulnerabilities which are not in this \n\
+                  older report or directory of reports, like the \n\
+                  ones of the main branch \n\
+  -S, --sort      list vulnerabilities by severity, file, category \n\
+                  or title rather than in report order. Press O in \n\
+                  the interface to switch \n\
+  -r, --root      root directory of the analyzed codebase, which \n\
+                  paths in reports are relative to (default: \n\
+                  current directory) \n\
+  -s, --stats     time loading and rendering stages, and print a \n\
+                  summary on standard error when quitting. Press s \n\
+                  in the interface to see timings of last render \n\
+  -W, --watch     reload reports when they're written again, keeping \n\
+                  current position, and snippets when source files \n\
+                  change \n\
+  ", progname, progname, DEFAULT_BATCH_WIDTH);
+}
+
+/*
+ * Load the new version of reports given as `reports`, and show it in
+ * place of current `vulnerabilities`, whose fingerprints are
+ * `fingerprints`. Those are replaced by the ones of the new version.
+ *
+ * Reports which did not change are loaded from their snapshot. If the
+ * new version can't be loaded, current one stays.
+ */
+static void
+reload_reports (char **reports, size_t reports_count, vulnerability_list_t *baseline, vulnerability_list_t *vulnerabilities, uint64_t **fingerprints, size_t *current_vulnerability, size_t *current_line)
+{
+  vulnerability_list_t fresh = {0};
+  diff_t diff = {0};
+
+  if (load_reports (reports, reports_count, &fresh))
+    {
+      // errors were written over the interface.
+      free_data (&fresh);
+      redraw_screen ();
+      show_message ("Can't reload reports, keeping previous version.");
+      return;
+    }
+
+  if (baseline)
+    keep_new_vulnerabilities (baseline, &fresh, &diff);
+
+  uint64_t *fresh_fingerprints = fingerprint_vulnerabilities (&fresh);
+  size_t *matches = xalloc ((fresh.count + 1) * sizeof (size_t));
+  match_vulnerabilities (*fingerprints, vulnerabilities->count, fresh_fingerprints, fresh.count, matches, &diff);
+
+  watch_sources (&fresh);
+  update_vulnerabilities (vulnerabilities, &fresh, matches, current_vulnerability, current_line);
+
+  free (*fingerprints);
+  *fingerprints = fresh_fingerprints;
+  free (matches);
+
+  char *message = xsprintf ("Reports reloaded: %zu new, %zu fixed and %zu unchanged vulnerabilities.", diff.new_count, diff.fixed_count, diff.unchanged_count);
+  show_message (message);
+  free (message);
+}
+
+/*
+ * In watch mode, show what changed since last check: `reports`, and
+ * source files snippets come from.
+ *
+ * `fingerprints` of current vulnerabilities were computed before their
+ * sources were watched, from the code they were found in, so that
+ * findings which moved in edited files are recognized.
+ */
+static void
+apply_changes (char **reports, size_t reports_count, vulnerability_list_t *baseline, vulnerability_list_t *vulnerabilities, uint64_t **fingerprints, size_t *current_vulnerability, size_t *current_line)
+{
+  watch_changes_t changes = {0};
+  if (!read_watch_changes (&changes))
+    return;
+
+  for (size_t i = 0; i < changes.count; i++)
+    refresh_source (vulnerabilities, changes.paths[i], current_vulnerability, current_line);
+
+  if (changes.report_changed)
+    reload_reports (reports, reports_count, baseline, vulnerabilities, fingerprints, current_vulnerability, current_line);
+
+  free_watch_changes (&changes);
 }
 
 int
 main (int argc, char **argv)
 {
   int err = 0;
-  vulnerability_t vulnerabilities[MAX_VULNERABILITY_COUNT] = {0};
-  size_t vulnerabilities_count = 0;
+  vulnerability_list_t vulnerabilities = {0};
+  vulnerability_list_t baseline = {0};
+  char *baseline_path = NULL;
+  bool batch = false;
+  long width = DEFAULT_BATCH_WIDTH;
+  const char *output_path = NULL;
+  FILE *output = stdout;
+  bool stats = false;
+  bool watch = false;
+  int sort = SORT_REPORT;
+  const char *root = NULL;
+  uint64_t *fingerprints = NULL;
 
-  if (argc != 2)
+  struct option options[] = {
+    { "help", no_argument, NULL, 'h' },
+    { "batch", no_argument, NULL, 'b' },
+    { "width", required_argument, NULL, 'w' },
+    { "output", required_argument, NULL, 'o' },
+    { "baseline", required_argument, NULL, 'B' },
+    { "sort", required_argument, NULL, 'S' },
+    { "root", required_argument, NULL, 'r' },
+    { "stats", no_argument, NULL, 's' },
+    { "watch", no_argument, NULL, 'W' },
+    { 0 },
+  };
+
+  int opt = 0;
+  while ((opt = getopt_long (argc, argv, "hbw:o:B:S:r:sW", options, NULL)) != -1)
+    {
+      switch (opt)
+        {
+          case 'h':
+            usage (argv[0]);
+            return 0;
+
+          case 'b':
+            batch = true;
+            break;
+
+          case 'w':
+            width = strtol (optarg, NULL, 10);
+            break;
+
+          case 'o':
+            output_path = optarg;
+            break;
+
+          case 'B':
+            baseline_path = optarg;
+            break;
+
+          case 'S':
+            sort = find_sort_key (optarg);
+            if (sort < 0)
+              {
+                fprintf (stderr, "main.c : main() : unknown sort key : %s\n", optarg);
+                return 1;
+              }
+            break;
+
+          case 'r':
+            root = optarg;
+            break;
+
+          case 's':
+            stats = true;
+            stats_enabled = true;
+            break;
+
+          case 'W':
+            watch = true;
+            break;
+
+          default:
+            usage (argv[0]);
+            return 1;
+        }
+    }
+
+  if (optind >= argc || width < 1)
     {
       usage (argv[0]);
       return 1;
     }
 
-  if (strncmp (argv[1], "--help", 6) == 0 || strncmp (argv[1], "-h", 2) == 0)
+  char **reports = argv + optind;
+  size_t reports_count = argc - optind;
+  size_t stdin_count = 0;
+  for (size_t i = 0; i < reports_count; i++)
+    if (strcmp (reports[i], "-") == 0)
+      stdin_count++;
+
+  if (baseline_path && strcmp (baseline_path, "-") == 0)
+    stdin_count++;
+
+  if (stdin_count > 1)
     {
-      usage (argv[0]);
-      return 0;
+      fprintf (stderr, "main.c : main() : standard input can only be read once.\n");
+      return 1;
+    }
+
+  if (watch && !batch && stdin_count > 0)
+    {
+      fprintf (stderr, "main.c : main() : can't watch standard input.\n");
+      return 1;
     }
 
-  err = parse_data (argv[1], vulnerabilities, &vulnerabilities_count);
+  // resolved once, rather than for each snippet.
+  if (set_source_root (root))
+    {
+      fprintf (stderr, "main.c : main() : can't resolve root directory : %s\n", root ? root : ".");
+      return 1;
+    }
+
+  err = load_reports (reports, reports_count, &vulnerabilities);
   if (err)
     {
       fprintf (stderr, "main.c : main() : can't parse data.\n");
       goto cleanup;
     }
 
-  init_ncurses (vulnerabilities, vulnerabilities_count);
+  if (baseline_path)
+    {
+      err = load_reports (&baseline_path, 1, &baseline);
+      if (err)
+        {
+          fprintf (stderr, "main.c : main() : can't parse baseline data.\n");
+          goto cleanup;
+        }
+
+      diff_t diff = {0};
+      keep_new_vulnerabilities (&baseline, &vulnerabilities, &diff);
+      fprintf (stderr, "%zu new, %zu fixed and %zu unchanged vulnerabilities since baseline.\n", diff.new_count, diff.fixed_count, diff.unchanged_count);
+
+      // new versions of the report are compared to it too.
+      if (!watch || batch)
+        free_data (&baseline);
+    }
+
+  if (batch)
+    {
+      if (output_path)
+        {
+          output = fopen (output_path, "w");
+          if (!output)
+            {
+              err = 1;
+              fprintf (stderr, "main.c : main() : can't open output file : %s\n", output_path);
+              goto cleanup;
+            }
+        }
+
+      err = print_vulnerabilities (&vulnerabilities, sort_order (&vulnerabilities, sort), width, output);
+      goto cleanup;
+    }
+
+  if (watch)
+    {
+      err = start_watch (reports, reports_count);
+      if (err)
+        {
+          fprintf (stderr, "main.c : main() : can't watch reports.\n");
+          goto cleanup;
+        }
+
+      // sources may change as soon as they're watched.
+      fingerprints = fingerprint_vulnerabilities (&vulnerabilities);
+      watch_sources (&vulnerabilities);
+    }
+
   size_t current_vulnerability = 0;
   size_t current_line = 0;
+  init_ncurses (&vulnerabilities, sort, &current_vulnerability);
 
   while (true)
     {
-      bool quit = handle_key (vulnerabilities, vulnerabilities_count, &current_vulnerability, &current_line);
+      bool quit = handle_key (&vulnerabilities, &current_vulnerability, &current_line);
       if (quit)
         break;
+
+      if (watch)
+        apply_changes (reports, reports_count, baseline_path ? &baseline : NULL, &vulnerabilities, &fingerprints, &current_vulnerability, &current_line);
     }
 
   cleanup:
-  cleanup_ncurses ();
-  free_data (vulnerabilities, vulnerabilities_count);
+  if (batch)
+    {
+      if (output && output != stdout) fclose (output);
+      free_sources ();
+      free_source_root ();
+      forget_sort_orders ();
+    }
+  else
+    cleanup_ncurses ();
+
+  stop_watch ();
+  if (fingerprints) free (fingerprints);
+  free_data (&baseline);
+  free_data (&vulnerabilities);
+
+  if (stats)
+    print_stats (stderr);
+
   return err;
 }
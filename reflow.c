@@ -1,321 +1,410 @@
-#include <ctype.h>
-#include <limits.h>
 #include <locale.h>
 #include <ncurses.h>
-#include <menu.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
 
+#include "arena.h"
 #include "data.h"
+#include "source.h"
 #include "reflow.h"
+#include "scan.h"
+#include "stats.h"
 #include "utils.h"
 
-#define MAX_LINE_LENGTH 1000
-char TOO_MANY_LINES[1000] = "report contains too many lines (max allowed: 1000).";
+/*
+ * Append the `len` first bytes of `content` to the text of `lines`.
+ *
+ * Returns where they are in the text.
+ */
+static size_t
+append_text (line_list_t *lines, const char *content, size_t len)
+{
+  lines->text = xgrow (lines->text, 1, lines->text_length + len, &lines->text_capacity);
+  memcpy (lines->text + lines->text_length, content, len);
 
+  size_t offset = lines->text_length;
+  lines->text_length += len;
+  return offset;
+}
+
+/*
+ * Append a line of `len` bytes of text, starting at `offset`.
+ */
 static void
-remove_breaks_within_paragraphs (size_t len, char *string)
+add_line (line_list_t *lines, size_t offset, size_t len, int flags)
 {
-  if (len == 0)
-    return;
+  lines->items = xgrow (lines->items, sizeof (*lines->items), lines->count + 1, &lines->capacity);
+  lines->items[lines->count++] = (line_t) { .offset = offset, .length = len, .flags = flags };
+}
+
+/*
+ * Append a line made of `content`, which is not wrapped.
+ */
+static void
+add_text_line (line_list_t *lines, const char *content, int flags)
+{
+  size_t len = strlen (content);
+  add_line (lines, append_text (lines, content, len), len, flags);
+}
+
+/*
+ * Tell if `string`, which is `len` bytes long, has `prefix` at `i`.
+ */
+static inline bool
+has_at (const char *string, size_t len, size_t i, const char *prefix, size_t prefix_len)
+{
+  return i + prefix_len <= len && memcmp (string + i, prefix, prefix_len) == 0;
+}
 
+/*
+ * Join lines of paragraphs, so they can be wrapped to any width.
+ * Paragraphs are separated by blank lines, and lines of code blocks are
+ * left untouched.
+ *
+ * Only newlines and backquotes matter here, so we jump from one to the
+ * next with `find_either()` rather than looking at every byte.
+ */
+static void
+remove_breaks_within_paragraphs (size_t len, char *string)
+{
+  const char *end = string + len;
   bool inside_code_block = false;
 
-  for (size_t i = 0; i < len; i++)
+  for (size_t i = find_either (string, end, '\n', '`') - string; i < len; i = find_either (string + i + 1, end, '\n', '`') - string)
     {
-      if (strncmp (string + i, "```", 3) == 0)
-        inside_code_block = !inside_code_block;
-
-      if (string[i] == '\n')
+      if (string[i] == '`')
         {
-          if (strncmp (string + i, "\n```", 4) == 0)
-            continue;
+          if (has_at (string, len, i, "```", 3))
+            inside_code_block = !inside_code_block;
 
-          if (strncmp (string + i, "\n\n", 2) == 0)
-            i++;
-          else
-            {
-              if (!inside_code_block)
-                string[i] = ' ';
-            }
+          continue;
         }
+
+      if (has_at (string, len, i, "\n```", 4))
+        continue;
+
+      if (has_at (string, len, i, "\n\n", 2))
+        i++;
+      else if (!inside_code_block)
+        string[i] = ' ';
     }
 }
 
-static int
-wrap (char *content, size_t max_width, line_t lines[MAX_LINES], size_t *count, char **err_msg, bool is_heading)
+/*
+ * Split the `len` bytes of text of `lines` starting at `offset` in
+ * lines of at most `max_width` bytes, breaking on whitespace when
+ * possible.
+ *
+ * Lines only point into the text. When a line is too long, we look for
+ * its last whitespace backward from `max_width`, so bytes are looked at
+ * most twice overall, and usually much less.
+ *
+ * Both newlines and whitespace are searched a block of bytes at a time,
+ * see scan.c.
+ */
+static void
+wrap (line_list_t *lines, size_t offset, size_t len, size_t max_width, int flags)
 {
-  int err = 0;
-  char *start = content;
-  while (start)
-    {
-      char *end = strstr (start, "\n");
-      size_t len = end ? (size_t) (end - start) : strnlen (start, MAX_LINE_LENGTH);
-      if (len > MAX_LINE_LENGTH)
-        len = MAX_LINE_LENGTH;
+  const char *text = lines->text;
+  const char *content_end = text + offset + len;
+  const char *start = text + offset;
 
-      char line[len + 2];
-      memset (line, 0, len + 2);
-      snprintf (line, len + 1, "%s", start);
+  if (max_width == 0)
+    max_width = 1;
 
-      char *part = line;
+  while (start)
+    {
+      const char *end = find_char (start, content_end, '\n');
+      const char *line = start;
 
-      while (true)
+      while ((size_t) (end - line) > max_width)
         {
-          if (*count + 1 == MAX_LINES)
-            {
-              err = 1;
-              *err_msg = TOO_MANY_LINES;
-              goto cleanup;
-            }
+          // first byte of a line is never a break point.
+          const char *last_space = find_last_space (line + 1, line + max_width + 1);
 
-          lines[*count].content = xalloc (max_width + 2);
-          lines[*count].heading = is_heading;
-          if (strnlen (part, MAX_LINE_LENGTH) > max_width)
+          if (last_space)
             {
-              int last_space = max_width;
-              for (int i = (int) max_width; i > 0; i--)
-                {
-                  if (isspace (part[i]))
-                    {
-                      last_space = i;
-                      break;
-                    }
-                }
-
-              snprintf (lines[*count].content, last_space + 1, "%s", part);
-              (*count)++;
-              part += last_space + 1;
+              add_line (lines, line - text, last_space - line, flags);
+              line = last_space + 1;
             }
           else
             {
-              snprintf (lines[*count].content, max_width + 1, "%s", part);
-              (*count)++;
-              break;
+              add_line (lines, line - text, max_width, flags);
+              line += max_width;
             }
         }
 
-      start = end;
-      if (start && start[0] != 0)
-        start++; // eat the \n character.
+      add_line (lines, line - text, end - line, flags);
+
+      start = NULL;
+      if (end < content_end)
+        start = end + 1; // eat the \n character.
     }
+}
 
-  cleanup:
-  return err;
+/*
+ * Append `content` to the text of `lines`, then reflow it.
+ */
+static void
+add_paragraphs (line_list_t *lines, const char *content, size_t len, size_t max_width, int flags)
+{
+  size_t offset = append_text (lines, content, len);
+  remove_breaks_within_paragraphs (len, lines->text + offset);
+  wrap (lines, offset, len, max_width, flags);
 }
 
 /*
  * Add location information as header.
  *
  * Parameters are the same than reflow().
- *
- * Returns non-zero in case of error.
  */
-static int
-process_filename (size_t max_width, vulnerability_t *vulnerability, line_t lines[MAX_LINES], size_t *count, char **err_msg)
+static void
+process_filename (size_t max_width, vulnerability_t *vulnerability, line_list_t *lines)
 {
-  char copy[MAX_LOCATION_LENGTH] = {0};
-  snprintf (copy, MAX_LOCATION_LENGTH - 1, "%s:%ld", vulnerability->file, vulnerability->line);
-  remove_breaks_within_paragraphs (MAX_LOCATION_LENGTH, copy);
-  return wrap (copy, max_width, lines, count, err_msg, true);
+  char number[24];
+  int number_len = snprintf (number, sizeof (number), ":%ld", vulnerability->line);
+
+  size_t offset = append_text (lines, vulnerability->file, strlen (vulnerability->file));
+  append_text (lines, number, number_len);
+
+  size_t len = lines->text_length - offset;
+  remove_breaks_within_paragraphs (len, lines->text + offset);
+  wrap (lines, offset, len, max_width, LINE_HEADING);
 }
 
 /*
  * Add category information as header.
  *
- * Parameters are the same than reflow(), minus error handling.
+ * Parameters are the same than reflow().
  */
 static void
-process_category (size_t max_width, vulnerability_t *vulnerability, line_t lines[MAX_LINES], size_t *count)
+process_category (size_t max_width, vulnerability_t *vulnerability, line_list_t *lines)
 {
-  lines[*count].content = xalloc (max_width + 1);
-  lines[*count].heading = true;
-  snprintf (lines[*count].content, max_width, "Category: %s", vulnerability->category);
-  remove_breaks_within_paragraphs (max_width + 1, lines[*count].content);
-  (*count)++;
+  size_t offset = append_text (lines, "Category: ", 10);
+  append_text (lines, vulnerability->category, strlen (vulnerability->category));
+
+  size_t len = lines->text_length - offset;
+  remove_breaks_within_paragraphs (len, lines->text + offset);
+  wrap (lines, offset, len, max_width, LINE_HEADING);
 }
 
 /*
- * Add title as header.
+ * Add the analyzer which found the vulnerability as header, since
+ * several reports may be shown together.
  *
  * Parameters are the same than reflow().
- *
- * Returns non-zero in case of error.
  */
-static int
-process_title (size_t max_width, vulnerability_t *vulnerability, line_t lines[MAX_LINES], size_t *count, char **err_msg)
+static void
+process_analyzer (size_t max_width, vulnerability_t *vulnerability, line_list_t *lines)
 {
-  char copy[MAX_TITLE_LENGTH] = {0};
-  snprintf (copy, MAX_TITLE_LENGTH - 1, "%s", vulnerability->title);
-  remove_breaks_within_paragraphs (MAX_TITLE_LENGTH, copy);
-  return wrap (copy, max_width, lines, count, err_msg, true);
+  size_t offset = append_text (lines, "Analyzer: ", 10);
+  append_text (lines, vulnerability->analyzer, strlen (vulnerability->analyzer));
+  wrap (lines, offset, lines->text_length - offset, max_width, LINE_HEADING);
 }
 
-static bool
-is_inside_current_dir (const char *target_path)
+/*
+ * Add severity and confidence as header, when the report tells them.
+ *
+ * Parameters are the same than reflow().
+ */
+static void
+process_levels (size_t max_width, vulnerability_t *vulnerability, line_list_t *lines)
 {
-  if (!target_path)
-    return false;
+  if (vulnerability->severity == SEVERITY_UNKNOWN && vulnerability->confidence == CONFIDENCE_UNKNOWN)
+    return;
 
-  char current_path[PATH_MAX + 1] = {0};
-  char real_current_path[PATH_MAX + 1] = {0};
-  char real_target_path[PATH_MAX + 1] = {0};
+  char header[64];
+  int len = snprintf (header, sizeof (header), "Severity: %s", severity_name (vulnerability->severity));
+  if (vulnerability->confidence != CONFIDENCE_UNKNOWN)
+    len += snprintf (header + len, sizeof (header) - len, " (confidence: %s)", confidence_name (vulnerability->confidence));
 
-  char *success = getcwd (current_path, PATH_MAX);
-  if (!success)
-    return false;
+  size_t offset = append_text (lines, header, len);
+  wrap (lines, offset, len, max_width, LINE_HEADING);
+}
 
-  success = realpath (current_path, real_current_path);
-  if (!success)
-    return false;
+/*
+ * Add title as header.
+ *
+ * Parameters are the same than reflow().
+ */
+static void
+process_title (size_t max_width, vulnerability_t *vulnerability, line_list_t *lines)
+{
+  add_paragraphs (lines, vulnerability->title, strlen (vulnerability->title), max_width, LINE_HEADING);
+}
 
-  success = realpath (target_path, real_target_path);
-  if (!success)
-    return false;
+/*
+ * Find the source file of `vulnerability`, to show a snippet of it.
+ * Only files inside the root of the analyzed codebase are shown.
+ *
+ * This resolves paths and reads the file the first time, so it may
+ * block on slow filesystems. Next times, it's a hash table lookup.
+ *
+ * Returns NULL if there's no snippet to show.
+ */
+const source_t *
+find_snippet_source (vulnerability_t *vulnerability)
+{
+  uint64_t timer = start_timer ();
+  const source_t *source = get_source (vulnerability->file);
 
-  return strncmp (real_current_path, real_target_path, strnlen (real_current_path, PATH_MAX)) == 0;
+  stop_timer (STAGE_SNIPPET, timer);
+  return source;
 }
 
 /*
- * Add category information as header.
+ * Add code snippet around the vulnerability location, from `source`.
  *
- * In case of error, it just silently fail, we don't want to interrupt
- * the program for that.
+ * Source files are read and indexed once by `get_source()`, so this
+ * does not depend on how far in the file the vulnerability is.
  *
- * Parameters are the same than reflow(), minus error handling.
+ * When the snippet is still being loaded, a placeholder takes its
+ * place. When there's no source, it just silently fail, we don't want
+ * to interrupt the program for that.
+ *
+ * Other parameters are the same than reflow().
  */
 static void
-add_snippet (size_t max_width, vulnerability_t *vulnerability, line_t lines[MAX_LINES], size_t *count)
+add_snippet (size_t max_width, vulnerability_t *vulnerability, const source_t *source, bool pending, line_list_t *lines)
 {
-  FILE *file = NULL;
-
-  if (!is_inside_current_dir (vulnerability->file))
-    return;
-
-  int err = access (vulnerability->file, R_OK);
-  if (err)
-    return;
+  if (pending)
+    {
+      add_text_line (lines, "Snippet:", 0);
+      add_text_line (lines, "(loading...)", 0);
+      add_text_line (lines, "", 0);
+      return;
+    }
 
-  file = fopen (vulnerability->file, "r");
-  if (!file)
+  if (!source)
     return;
 
-  size_t start = 0;
+  size_t start = 1;
   size_t end = vulnerability->line + 2;
 
-  if ((int) vulnerability->line - 2 > 0)
+  if (vulnerability->line > 2)
     start = vulnerability->line - 2;
 
+  add_text_line (lines, "Snippet:", 0);
+  add_text_line (lines, "```", 0);
 
-  lines[*count].content = xalloc (max_width + 1);
-  snprintf (lines[*count].content, max_width, "Snippet:");
-  (*count)++;
-
-  lines[*count].content = xalloc (max_width + 1);
-  snprintf (lines[*count].content, max_width, "```");
-  (*count)++;
-
-  char line[MAX_LINE_LENGTH + 1] = {0};
-  size_t current_line = 0;
-  while (true)
+  for (size_t number = start; number <= end; number++)
     {
-      current_line++;
-      char *read = fgets (line, MAX_LINE_LENGTH, file);
-      if (!read)
+      const char *content = NULL;
+      size_t len = 0;
+      if (!get_source_line (source, number, &content, &len))
         break;
 
-      if (current_line >= start && current_line <= end)
-        {
-          if (line[strnlen (line, MAX_LINE_LENGTH) - 1] == '\n')
-            line[strnlen (line, MAX_LINE_LENGTH) - 1] = 0;
-
-          char *err_msg = NULL;
-          bool highlight = false;
-          if (current_line == vulnerability->line)
-            highlight = true;
-
-          err = wrap (line, max_width, lines, count, &err_msg, highlight);
-          if (err_msg)
-            free (err_msg);
-          if (err)
-            goto cleanup;
-        }
-
-      if (strnlen (read, MAX_LINE_LENGTH) == MAX_LINE_LENGTH)
-        current_line--; // this is a very long line
+      int flags = 0;
+      if (number == vulnerability->line)
+        flags = LINE_HEADING;
 
-      if (current_line > end)
-        break;
+      wrap (lines, append_text (lines, content, len), len, max_width, flags);
     }
 
-  lines[*count].content = xalloc (max_width + 1);
-  snprintf (lines[*count].content, max_width, "```");
-  (*count)++;
-
-  lines[*count].content = xalloc (1);
-  (*count)++;
-
-  cleanup:
-  if (file) fclose (file);
+  add_text_line (lines, "```", 0);
+  add_text_line (lines, "", 0);
 }
 
 /*
  * Add body content.
  *
- * Parameters are the same than reflow().
+ * When there is a solution, it's only put together with the message
+ * here, when displayed.
  *
- * Returns non-zero in case of error.
+ * Parameters are the same than reflow().
  */
-static int
-process_body (size_t max_width, vulnerability_t *vulnerability, line_t lines[MAX_LINES], size_t *count, char **err_msg)
+static void
+process_body (size_t max_width, vulnerability_t *vulnerability, line_list_t *lines)
 {
-  int err = 0;
-  char *desc_copy = NULL;
+  const char *description = vulnerability->description ? vulnerability->description : "";
+  size_t offset = lines->text_length;
 
-  desc_copy = strndup (vulnerability->description, MAX_DESC_LENGTH);
-  remove_breaks_within_paragraphs (strnlen (desc_copy, MAX_DESC_LENGTH) + 1, desc_copy);
+  if (vulnerability->solution)
+    {
+      append_text (lines, "Message: ", 9);
+      append_text (lines, description, strlen (description));
+      append_text (lines, "\n\nSolution: ", 12);
+      append_text (lines, vulnerability->solution, strlen (vulnerability->solution));
+      append_text (lines, "\n", 1);
+    }
+  else
+    append_text (lines, description, strlen (description));
 
-  err = wrap (desc_copy, max_width, lines, count, err_msg, false);
-  if (desc_copy) free (desc_copy);
-  return err;
+  size_t len = lines->text_length - offset;
+  remove_breaks_within_paragraphs (len, lines->text + offset);
+  wrap (lines, offset, len, max_width, 0);
 }
 
 /*
  * Reformat lines to fit the available `max_width`, so we know exactly
  * how many lines we need.
  *
- * That number of lines will be put into `count`, and the lines
- * will be in `lines`.
- *
- * You're responsible for freeing the strings contains in `lines`.
+ * Lines are appended to `lines`, which grows as needed. Their text is
+ * copied once in `lines->text`, lines are only positions in it. You're
+ * responsible for freeing it with `free_lines()`.
+ */
+void
+reflow (size_t max_width, vulnerability_t *vulnerability, line_list_t *lines)
+{
+  reflow_with_snippet (max_width, vulnerability, find_snippet_source (vulnerability), false, lines);
+}
+
+/*
+ * Same as reflow(), with the snippet taken from `source`, which was
+ * found by find_snippet_source(). If `pending` is true, the source is
+ * still being looked for, and a placeholder is shown instead.
  *
- * Returns non-zero in case of error. An error message will be in
- * `err_msg`. It's statically allocated, you don't need to free it.
+ * This never touches the filesystem, so it does not block.
  */
-int
-reflow (size_t max_width, vulnerability_t *vulnerability, line_t lines[MAX_LINES], size_t *count, char **err_msg)
+void
+reflow_with_snippet (size_t max_width, vulnerability_t *vulnerability, const source_t *source, bool pending, line_list_t *lines)
 {
-  int err = process_filename (max_width, vulnerability, lines, count, err_msg);
-  if (err)
-    return err;
+  uint64_t timer = start_timer ();
+  size_t initial_count = lines->count;
 
-  process_category (max_width, vulnerability, lines, count);
+  // reserve memory once rather than growing it for every piece of text.
+  size_t expected = strlen (vulnerability->file) + strlen (vulnerability->category) + strlen (vulnerability->title) + strlen (vulnerability->analyzer) + 64;
+  if (vulnerability->description) expected += strlen (vulnerability->description);
+  if (vulnerability->solution) expected += strlen (vulnerability->solution) + 32;
 
-  err = process_title (max_width, vulnerability, lines, count, err_msg);
-  if (err)
-    return err;
+  lines->text = xgrow (lines->text, 1, lines->text_length + expected, &lines->text_capacity);
+  lines->items = xgrow (lines->items, sizeof (*lines->items), lines->count + expected / (max_width ? max_width : 1) + 16, &lines->capacity);
+
+  process_filename (max_width, vulnerability, lines);
+  process_category (max_width, vulnerability, lines);
+  process_analyzer (max_width, vulnerability, lines);
+  process_levels (max_width, vulnerability, lines);
+  process_title (max_width, vulnerability, lines);
 
   // blank line between headers and body
-  lines[*count].content = xalloc (1);
-  (*count)++;
+  add_text_line (lines, "", 0);
+
+  add_snippet (max_width, vulnerability, source, pending, lines);
+  process_body (max_width, vulnerability, lines);
 
-  add_snippet (max_width, vulnerability, lines, count);
+  stop_timer (STAGE_REFLOW, timer);
+  count_stat (COUNTER_LINES, lines->count - initial_count);
+}
 
-  err = process_body (max_width, vulnerability, lines, count, err_msg);
-  if (err)
-    return err;
+/*
+ * Free lines memory.
+ */
+void
+free_lines (line_list_t *lines)
+{
+  if (lines->items) free (lines->items);
+  if (lines->text) free (lines->text);
+  memset (lines, 0, sizeof (*lines));
+}
 
-  return 0;
+/*
+ * Remove all lines, keeping memory around to reflow something else.
+ */
+void
+clear_lines (line_list_t *lines)
+{
+  lines->count = 0;
+  lines->text_length = 0;
 }
@@ -1,13 +1,33 @@
 #ifndef _REFLOW_H_
 #define _REFLOW_H_
 
-#define MAX_LINES 2000
+enum {
+  LINE_HEADING = 1,
+};
 
+/*
+ * A line is `length` bytes of the text of its list, starting at
+ * `offset`. It's not NUL terminated.
+ */
 typedef struct {
-  char *content;
-  bool heading;
+  size_t offset;
+  size_t length;
+  int flags;
 } line_t;
 
-int reflow (size_t max_width, vulnerability_t *vulnerability, line_t lines[MAX_LINES], size_t *count, char **err_msg);
+typedef struct {
+  char *text;
+  size_t text_length;
+  size_t text_capacity;
+  line_t *items;
+  size_t count;
+  size_t capacity;
+} line_list_t;
+
+const source_t *find_snippet_source (vulnerability_t *vulnerability);
+void reflow (size_t max_width, vulnerability_t *vulnerability, line_list_t *lines);
+void reflow_with_snippet (size_t max_width, vulnerability_t *vulnerability, const source_t *source, bool pending, line_list_t *lines);
+void free_lines (line_list_t *lines);
+void clear_lines (line_list_t *lines);
 
 #endif
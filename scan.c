@@ -0,0 +1,208 @@
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+#include "scan.h"
+
+/*
+ * Those helpers look at 16 (SSE2) or 32 (AVX2) bytes at once when the
+ * compiler targets those instruction sets, and fall back to bytewise
+ * loops otherwise.
+ *
+ * Whitespace is what `isspace()` matches in the C and UTF-8 locales:
+ * space, and \t to \r.
+ */
+
+#define IS_SPACE(c) ((c) == ' ' || (unsigned char) ((c) - '\t') <= '\r' - '\t')
+
+#if defined (__AVX2__)
+#define BLOCK_SIZE 32
+typedef uint32_t mask_t;
+
+static inline mask_t
+match_block (const char *block, char c)
+{
+  __m256i chunk = _mm256_loadu_si256 ((const __m256i *) block);
+  return _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (chunk, _mm256_set1_epi8 (c)));
+}
+
+static inline mask_t
+match_block_either (const char *block, char a, char b)
+{
+  __m256i chunk = _mm256_loadu_si256 ((const __m256i *) block);
+  __m256i matches = _mm256_or_si256 (_mm256_cmpeq_epi8 (chunk, _mm256_set1_epi8 (a)), _mm256_cmpeq_epi8 (chunk, _mm256_set1_epi8 (b)));
+  return _mm256_movemask_epi8 (matches);
+}
+
+static inline mask_t
+match_block_space (const char *block)
+{
+  __m256i chunk = _mm256_loadu_si256 ((const __m256i *) block);
+  __m256i shifted = _mm256_sub_epi8 (chunk, _mm256_set1_epi8 ('\t'));
+  __m256i controls = _mm256_cmpeq_epi8 (_mm256_min_epu8 (shifted, _mm256_set1_epi8 ('\r' - '\t')), shifted);
+  return _mm256_movemask_epi8 (_mm256_or_si256 (controls, _mm256_cmpeq_epi8 (chunk, _mm256_set1_epi8 (' '))));
+}
+#elif defined (__SSE2__)
+#define BLOCK_SIZE 16
+typedef uint32_t mask_t;
+
+static inline mask_t
+match_block (const char *block, char c)
+{
+  __m128i chunk = _mm_loadu_si128 ((const __m128i *) block);
+  return _mm_movemask_epi8 (_mm_cmpeq_epi8 (chunk, _mm_set1_epi8 (c)));
+}
+
+static inline mask_t
+match_block_either (const char *block, char a, char b)
+{
+  __m128i chunk = _mm_loadu_si128 ((const __m128i *) block);
+  __m128i matches = _mm_or_si128 (_mm_cmpeq_epi8 (chunk, _mm_set1_epi8 (a)), _mm_cmpeq_epi8 (chunk, _mm_set1_epi8 (b)));
+  return _mm_movemask_epi8 (matches);
+}
+
+static inline mask_t
+match_block_space (const char *block)
+{
+  __m128i chunk = _mm_loadu_si128 ((const __m128i *) block);
+  __m128i shifted = _mm_sub_epi8 (chunk, _mm_set1_epi8 ('\t'));
+  __m128i controls = _mm_cmpeq_epi8 (_mm_min_epu8 (shifted, _mm_set1_epi8 ('\r' - '\t')), shifted);
+  return _mm_movemask_epi8 (_mm_or_si128 (controls, _mm_cmpeq_epi8 (chunk, _mm_set1_epi8 (' '))));
+}
+#endif
+
+/*
+ * Find first occurrence of `c` between `start` and `end`.
+ *
+ * Returns `end` if there is none.
+ */
+const char *
+find_char (const char *start, const char *end, char c)
+{
+  const char *current = start;
+
+#ifdef BLOCK_SIZE
+  while (end - current >= BLOCK_SIZE)
+    {
+      mask_t mask = match_block (current, c);
+      if (mask)
+        return current + __builtin_ctz (mask);
+
+      current += BLOCK_SIZE;
+    }
+#endif
+
+  const char *found = memchr (current, c, end - current);
+  return found ? found : end;
+}
+
+/*
+ * Find first occurrence of either `a` or `b` between `start` and `end`.
+ *
+ * Returns `end` if there is none.
+ */
+const char *
+find_either (const char *start, const char *end, char a, char b)
+{
+  const char *current = start;
+
+#ifdef BLOCK_SIZE
+  while (end - current >= BLOCK_SIZE)
+    {
+      mask_t mask = match_block_either (current, a, b);
+      if (mask)
+        return current + __builtin_ctz (mask);
+
+      current += BLOCK_SIZE;
+    }
+#endif
+
+  for (; current < end; current++)
+    if (*current == a || *current == b)
+      return current;
+
+  return end;
+}
+
+/*
+ * Find last whitespace between `start` and `end`, going backward.
+ *
+ * Returns NULL if there is none.
+ */
+const char *
+find_last_space (const char *start, const char *end)
+{
+  const char *current = end;
+
+#ifdef BLOCK_SIZE
+  while (current - start >= BLOCK_SIZE)
+    {
+      current -= BLOCK_SIZE;
+      mask_t mask = match_block_space (current);
+      if (mask)
+        return current + 31 - __builtin_clz (mask);
+    }
+#endif
+
+  while (current > start)
+    {
+      current--;
+      if (IS_SPACE (*current))
+        return current;
+    }
+
+  return NULL;
+}
+
+/*
+ * Count occurrences of `c` in the `len` first bytes of `data`.
+ */
+size_t
+count_char (const char *data, size_t len, char c)
+{
+  size_t count = 0;
+  size_t i = 0;
+
+#ifdef BLOCK_SIZE
+  for (; i + BLOCK_SIZE <= len; i += BLOCK_SIZE)
+    count += __builtin_popcount (match_block (data + i, c));
+#endif
+
+  for (; i < len; i++)
+    if (data[i] == c)
+      count++;
+
+  return count;
+}
+
+/*
+ * Write in `offsets` the position of each occurrence of `c` in the `len`
+ * first bytes of `data`.
+ *
+ * `offsets` must be big enough, see `count_char()`.
+ */
+void
+index_char (const char *data, size_t len, char c, size_t *offsets)
+{
+  size_t count = 0;
+  size_t i = 0;
+
+#ifdef BLOCK_SIZE
+  for (; i + BLOCK_SIZE <= len; i += BLOCK_SIZE)
+    {
+      mask_t mask = match_block (data + i, c);
+      while (mask)
+        {
+          offsets[count++] = i + __builtin_ctz (mask);
+          mask &= mask - 1;
+        }
+    }
+#endif
+
+  for (; i < len; i++)
+    if (data[i] == c)
+      offsets[count++] = i;
+}
@@ -0,0 +1,12 @@
+#ifndef _SCAN_H_
+#define _SCAN_H_
+
+#include <stddef.h>
+
+const char *find_char (const char *start, const char *end, char c);
+const char *find_either (const char *start, const char *end, char a, char b);
+const char *find_last_space (const char *start, const char *end);
+size_t count_char (const char *data, size_t len, char c);
+void index_char (const char *data, size_t len, char c, size_t *offsets);
+
+#endif
@@ -0,0 +1,291 @@
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "data.h"
+#include "search.h"
+#include "utils.h"
+
+/*
+ * Vulnerabilities containing a given trigram, in increasing order.
+ */
+typedef struct {
+  bool used;
+  uint32_t trigram;
+  size_t last;
+  size_t *postings;
+  size_t count;
+  size_t capacity;
+} posting_list_t;
+
+static posting_list_t *index_table = NULL;
+static size_t index_count = 0;
+static size_t index_capacity = 0;
+
+static pthread_t builder;
+static bool building = false;
+
+static inline uint32_t
+make_trigram (unsigned char a, unsigned char b, unsigned char c)
+{
+  return ((uint32_t) tolower (a) << 16) | ((uint32_t) tolower (b) << 8) | (uint32_t) tolower (c);
+}
+
+static inline size_t
+hash_trigram (uint32_t trigram)
+{
+  return (trigram * 2654435761u) & (index_capacity - 1);
+}
+
+/*
+ * Find the posting list of `trigram`, or the empty slot where it would be.
+ */
+static posting_list_t *
+find_slot (uint32_t trigram)
+{
+  size_t slot = hash_trigram (trigram);
+  while (index_table[slot].used && index_table[slot].trigram != trigram)
+    slot = (slot + 1) & (index_capacity - 1);
+
+  return &index_table[slot];
+}
+
+static void
+grow_index ()
+{
+  posting_list_t *old = index_table;
+  size_t old_capacity = index_capacity;
+
+  index_capacity = index_capacity ? index_capacity * 2 : 4096;
+  index_table = xalloc (index_capacity * sizeof (*index_table));
+
+  for (size_t i = 0; i < old_capacity; i++)
+    if (old[i].used)
+      *find_slot (old[i].trigram) = old[i];
+
+  if (old) free (old);
+}
+
+/*
+ * Record that vulnerability `index` contains the trigrams of `text`.
+ */
+static void
+index_text (const char *text, size_t index)
+{
+  if (!text)
+    return;
+
+  size_t len = strlen (text);
+  for (size_t i = 0; i + 2 < len; i++)
+    {
+      uint32_t trigram = make_trigram (text[i], text[i + 1], text[i + 2]);
+      posting_list_t *list = find_slot (trigram);
+      if (!list->used)
+        {
+          if ((index_count + 1) * 2 > index_capacity)
+            {
+              grow_index ();
+              list = find_slot (trigram);
+            }
+
+          list->used = true;
+          list->trigram = trigram;
+          index_count++;
+        }
+
+      // `last` is index + 1, so that 0 means nothing was added yet.
+      if (list->last == index + 1)
+        continue;
+
+      list->postings = xgrow (list->postings, sizeof (size_t), list->count + 1, &list->capacity);
+      list->postings[list->count++] = index;
+      list->last = index + 1;
+    }
+}
+
+static void *
+build_index (void *data)
+{
+  vulnerability_list_t *vulnerabilities = data;
+  grow_index ();
+
+  for (size_t i = 0; i < vulnerabilities->count; i++)
+    {
+      vulnerability_t *vuln = &vulnerabilities->items[i];
+      index_text (vuln->title, i);
+      index_text (vuln->description, i);
+      index_text (vuln->solution, i);
+      index_text (vuln->category, i);
+      index_text (vuln->file, i);
+    }
+
+  return NULL;
+}
+
+/*
+ * Wait for the index to be built, if it's being built.
+ */
+static void
+wait_index ()
+{
+  if (!building)
+    return;
+
+  pthread_join (builder, NULL);
+  building = false;
+}
+
+/*
+ * Keep in `candidates` only the items also in `postings`. Both are
+ * sorted.
+ *
+ * Returns the new count of candidates.
+ */
+static size_t
+intersect (size_t *candidates, size_t count, const size_t *postings, size_t postings_count)
+{
+  size_t kept = 0;
+  size_t j = 0;
+
+  for (size_t i = 0; i < count; i++)
+    {
+      while (j < postings_count && postings[j] < candidates[i])
+        j++;
+
+      if (j == postings_count)
+        break;
+
+      if (postings[j] == candidates[i])
+        candidates[kept++] = candidates[i];
+    }
+
+  return kept;
+}
+
+static bool
+matches (vulnerability_t *vuln, const char *query)
+{
+  return (vuln->title && strcasestr (vuln->title, query))
+    || (vuln->description && strcasestr (vuln->description, query))
+    || (vuln->solution && strcasestr (vuln->solution, query))
+    || (vuln->category && strcasestr (vuln->category, query))
+    || (vuln->file && strcasestr (vuln->file, query));
+}
+
+static int
+compare_lists (const void *a, const void *b)
+{
+  const posting_list_t *x = *(posting_list_t * const *) a;
+  const posting_list_t *y = *(posting_list_t * const *) b;
+  return (x->count > y->count) - (x->count < y->count);
+}
+
+/*
+ * Index trigrams of title, description, category and file of all
+ * vulnerabilities, so that `search_vulnerabilities()` does not have
+ * to scan them all.
+ *
+ * This runs on a background thread. Vulnerabilities must not change
+ * until `free_search_index()` is called.
+ */
+void
+build_search_index (vulnerability_list_t *vulnerabilities)
+{
+  building = pthread_create (&builder, NULL, build_index, vulnerabilities) == 0;
+  if (!building)
+    build_index (vulnerabilities);
+}
+
+/*
+ * Find vulnerabilities whose title, description, category or file
+ * contains `query`, ignoring case.
+ *
+ * If `within` is not NULL, only those `within_count` vulnerabilities
+ * are considered, which makes refining a previous search cheap. It
+ * may be the same buffer as `results`, which must be big enough to
+ * hold all candidates.
+ *
+ * Returns how many indices have been written in `results`, in
+ * increasing order.
+ */
+size_t
+search_vulnerabilities (vulnerability_list_t *vulnerabilities, const char *query, const size_t *within, size_t within_count, size_t *results)
+{
+  size_t len = strlen (query);
+  size_t count = 0;
+
+  if (len < 3)
+    {
+      size_t total = within ? within_count : vulnerabilities->count;
+      for (size_t i = 0; i < total; i++)
+        {
+          size_t index = within ? within[i] : i;
+          if (matches (&vulnerabilities->items[index], query))
+            results[count++] = index;
+        }
+
+      return count;
+    }
+
+  wait_index ();
+
+  size_t trigrams_count = len - 2;
+  posting_list_t *lists[MAX_QUERY_LENGTH] = {0};
+  if (trigrams_count > MAX_QUERY_LENGTH)
+    trigrams_count = MAX_QUERY_LENGTH;
+
+  for (size_t i = 0; i < trigrams_count; i++)
+    {
+      lists[i] = find_slot (make_trigram (query[i], query[i + 1], query[i + 2]));
+      if (!lists[i]->used)
+        return 0;
+    }
+
+  // start from the rarest trigram, so intersections are small.
+  qsort (lists, trigrams_count, sizeof (*lists), compare_lists);
+
+  if (within)
+    {
+      memmove (results, within, within_count * sizeof (size_t));
+      count = intersect (results, within_count, lists[0]->postings, lists[0]->count);
+    }
+  else
+    {
+      memcpy (results, lists[0]->postings, lists[0]->count * sizeof (size_t));
+      count = lists[0]->count;
+    }
+
+  for (size_t i = 1; i < trigrams_count && count > 0; i++)
+    count = intersect (results, count, lists[i]->postings, lists[i]->count);
+
+  // trigrams only tell the query may be there, check it actually is.
+  size_t kept = 0;
+  for (size_t i = 0; i < count; i++)
+    if (matches (&vulnerabilities->items[results[i]], query))
+      results[kept++] = results[i];
+
+  return kept;
+}
+
+/*
+ * Free memory held by search index.
+ */
+void
+free_search_index ()
+{
+  wait_index ();
+
+  for (size_t i = 0; i < index_capacity; i++)
+    if (index_table[i].postings)
+      free (index_table[i].postings);
+
+  if (index_table) free (index_table);
+  index_table = NULL;
+  index_count = 0;
+  index_capacity = 0;
+}
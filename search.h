@@ -0,0 +1,10 @@
+#ifndef _SEARCH_H_
+#define _SEARCH_H_
+
+#define MAX_QUERY_LENGTH 256
+
+void build_search_index (vulnerability_list_t *vulnerabilities);
+size_t search_vulnerabilities (vulnerability_list_t *vulnerabilities, const char *query, const size_t *within, size_t within_count, size_t *results);
+void free_search_index ();
+
+#endif
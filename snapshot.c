@@ -0,0 +1,486 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "data.h"
+#include "snapshot.h"
+#include "utils.h"
+
+#define SNAPSHOT_MAGIC "SASTY\0\0\4"
+#define SNAPSHOT_NULL UINT64_MAX
+#define HASH_PRIME 0x9E3779B97F4A7C15ULL
+#define HASH_BUFFER_SIZE 65536
+
+/*
+ * A snapshot is a header, then a record per vulnerability, then all
+ * strings, NUL terminated. Records refer to strings by their offset
+ * from the start of strings, so the file can be used as is once mapped.
+ */
+typedef struct {
+  char magic[8];
+  snapshot_key_t key;
+  uint64_t count;
+  uint64_t strings_size;
+} snapshot_header_t;
+
+typedef struct {
+  uint64_t analyzer;
+  uint64_t category;
+  uint64_t title;
+  uint64_t description;
+  uint64_t solution;
+  uint64_t file;
+  uint64_t line;
+  uint32_t severity;
+  uint32_t confidence;
+} snapshot_record_t;
+
+/*
+ * Hash report content, to know if a snapshot still matches it.
+ *
+ * This reads 32 bytes at a time into four independent lanes, so it
+ * runs much faster than byte by byte hashes. It does not need to
+ * resist collisions made on purpose.
+ *
+ * Content can be hashed in pieces: `hash_blocks()` takes as many 32
+ * bytes blocks of `data` as it can, and returns how many bytes it took.
+ * Once there are no more pieces, `finish_hash()` takes the rest.
+ */
+static size_t
+hash_blocks (uint64_t lanes[4], const unsigned char *data, size_t len)
+{
+  size_t i = 0;
+
+  for (; i + 32 <= len; i += 32)
+    for (int j = 0; j < 4; j++)
+      {
+        uint64_t word;
+        memcpy (&word, data + i + j * 8, sizeof (word));
+        lanes[j] = (lanes[j] ^ word) * HASH_PRIME;
+        lanes[j] ^= lanes[j] >> 29;
+      }
+
+  return i;
+}
+
+/*
+ * Finish hash of `total_len` bytes, whose last `len` bytes at `data`
+ * did not make a whole block.
+ */
+static uint64_t
+finish_hash (uint64_t lanes[4], size_t total_len, const unsigned char *data, size_t len)
+{
+  uint64_t hash = total_len;
+  for (int j = 0; j < 4; j++)
+    {
+      hash = (hash ^ lanes[j]) * HASH_PRIME;
+      hash ^= hash >> 32;
+    }
+
+  for (size_t i = 0; i < len; i++)
+    hash = (hash ^ data[i]) * HASH_PRIME;
+
+  return hash;
+}
+
+static uint64_t
+hash_content (const unsigned char *data, size_t len)
+{
+  uint64_t lanes[4] = { 1, 2, 3, 4 };
+  size_t taken = hash_blocks (lanes, data, len);
+  return finish_hash (lanes, len, data + taken, len - taken);
+}
+
+/*
+ * Find where snapshots are stored, following XDG base directory
+ * specification.
+ *
+ * Returns NULL if there is no suitable place.
+ */
+static char *
+snapshot_directory ()
+{
+  const char *cache = getenv ("XDG_CACHE_HOME");
+  if (cache && *cache == '/')
+    return xsprintf ("%s/sasty", cache);
+
+  const char *home = getenv ("HOME");
+  if (home && *home)
+    return xsprintf ("%s/.cache/sasty", home);
+
+  return NULL;
+}
+
+/*
+ * Find the path of the snapshot of report at `uri`, which depends on
+ * report's absolute path.
+ *
+ * Returns NULL if there is none.
+ */
+static char *
+snapshot_path (const char *uri, const char *directory)
+{
+  char *real = realpath (uri, NULL);
+  if (!real)
+    return NULL;
+
+  uint64_t hash = hash_content ((const unsigned char *) real, strlen (real));
+  free (real);
+
+  return xsprintf ("%s/%016llx.snapshot", directory, (unsigned long long) hash);
+}
+
+/*
+ * Create `directory` and its missing parents.
+ *
+ * Returns non-zero in case of error.
+ */
+static int
+make_directories (char *directory)
+{
+  for (char *slash = strchr (directory + 1, '/'); slash; slash = strchr (slash + 1, '/'))
+    {
+      *slash = 0;
+      int err = mkdir (directory, 0700) && errno != EEXIST;
+      *slash = '/';
+      if (err)
+        return 1;
+    }
+
+  return mkdir (directory, 0700) && errno != EEXIST;
+}
+
+/*
+ * Identify current content of report at `uri` by its size,
+ * modification time and content hash.
+ *
+ * The report is read rather than mapped: analyzers may rewrite it in
+ * place while we hash it, and reading a mapping past its new end would
+ * crash. If it changed meanwhile, it's not identified.
+ *
+ * Returns non-zero if it can't be identified, for example because it's
+ * not a regular file.
+ */
+int
+get_snapshot_key (const char *uri, snapshot_key_t *key)
+{
+  int err = 1;
+  unsigned char *buffer = NULL;
+  int fd = open (uri, O_RDONLY);
+  if (fd < 0)
+    return 1;
+
+  struct stat info;
+  if (fstat (fd, &info) || !S_ISREG (info.st_mode) || info.st_size == 0)
+    goto cleanup;
+
+  posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  buffer = xalloc (HASH_BUFFER_SIZE);
+  uint64_t lanes[4] = { 1, 2, 3, 4 };
+  size_t total_len = 0;
+  size_t len = 0;
+
+  // the buffer is hashed once full, so that blocks are the same as when
+  // hashing the file at once.
+  while (true)
+    {
+      ssize_t count = read (fd, buffer + len, HASH_BUFFER_SIZE - len);
+      if (count < 0 && errno == EINTR)
+        continue;
+
+      if (count < 0)
+        goto cleanup;
+
+      if (count == 0)
+        break;
+
+      len += count;
+      total_len += count;
+      if (len == HASH_BUFFER_SIZE)
+        len -= hash_blocks (lanes, buffer, len);
+    }
+
+  size_t taken = hash_blocks (lanes, buffer, len);
+
+  struct stat current;
+  if (fstat (fd, &current) || total_len != (size_t) info.st_size || current.st_size != info.st_size
+      || current.st_mtim.tv_sec != info.st_mtim.tv_sec || current.st_mtim.tv_nsec != info.st_mtim.tv_nsec)
+    goto cleanup;
+
+  memset (key, 0, sizeof (*key));
+  key->size = info.st_size;
+  key->mtime_sec = info.st_mtim.tv_sec;
+  key->mtime_nsec = info.st_mtim.tv_nsec;
+  key->hash = finish_hash (lanes, total_len, buffer + taken, len - taken);
+  err = 0;
+
+  cleanup:
+  close (fd);
+  if (buffer) free (buffer);
+  return err;
+}
+
+/*
+ * Tell if snapshot in `data` is well formed and matches `key`, so it
+ * can be used without further checks.
+ */
+static bool
+is_valid_snapshot (const char *data, size_t size, const snapshot_key_t *key)
+{
+  if (size < sizeof (snapshot_header_t))
+    return false;
+
+  const snapshot_header_t *header = (const snapshot_header_t *) data;
+  if (memcmp (header->magic, SNAPSHOT_MAGIC, sizeof (header->magic)) || memcmp (&header->key, key, sizeof (*key)))
+    return false;
+
+  size_t available = size - sizeof (*header);
+  if (header->count > available / sizeof (snapshot_record_t))
+    return false;
+
+  size_t records_size = header->count * sizeof (snapshot_record_t);
+  if (header->strings_size != available - records_size || header->strings_size == 0)
+    return false;
+
+  const char *strings = data + sizeof (*header) + records_size;
+  if (strings[header->strings_size - 1] != 0)
+    return false;
+
+  const snapshot_record_t *records = (const snapshot_record_t *) (data + sizeof (*header));
+  for (size_t i = 0; i < header->count; i++)
+    {
+      const uint64_t offsets[] = { records[i].analyzer, records[i].category, records[i].title, records[i].description, records[i].solution, records[i].file };
+      for (size_t j = 0; j < sizeof (offsets) / sizeof (*offsets); j++)
+        if (offsets[j] != SNAPSHOT_NULL && offsets[j] >= header->strings_size)
+          return false;
+
+      if (records[i].severity >= SEVERITIES_COUNT || records[i].confidence >= CONFIDENCES_COUNT)
+        return false;
+    }
+
+  return true;
+}
+
+/*
+ * Load vulnerabilities of report at `uri` from its snapshot, if there
+ * is one matching `key`.
+ *
+ * The snapshot is mapped and vulnerabilities strings point directly
+ * into it, so nothing is parsed or copied. `vulnerabilities` must be
+ * empty.
+ *
+ * Returns non-zero if there is no usable snapshot.
+ */
+int
+load_snapshot (const char *uri, const snapshot_key_t *key, vulnerability_list_t *vulnerabilities)
+{
+  int err = 1;
+  char *directory = NULL;
+  char *path = NULL;
+  int fd = -1;
+  char *data = MAP_FAILED;
+  size_t size = 0;
+
+  if (vulnerabilities->count > 0 || vulnerabilities->mappings_count > 0)
+    goto cleanup;
+
+  directory = snapshot_directory ();
+  if (!directory)
+    goto cleanup;
+
+  path = snapshot_path (uri, directory);
+  if (!path)
+    goto cleanup;
+
+  fd = open (path, O_RDONLY);
+  if (fd < 0)
+    goto cleanup;
+
+  struct stat info;
+  if (fstat (fd, &info) || !S_ISREG (info.st_mode))
+    goto cleanup;
+
+  size = info.st_size;
+  data = size > 0 ? mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  if (data == MAP_FAILED || !is_valid_snapshot (data, size, key))
+    goto cleanup;
+
+  const snapshot_header_t *header = (const snapshot_header_t *) data;
+  const snapshot_record_t *records = (const snapshot_record_t *) (data + sizeof (*header));
+  char *strings = data + sizeof (*header) + header->count * sizeof (snapshot_record_t);
+
+  vulnerabilities->items = xalloc ((header->count + 1) * sizeof (vulnerability_t));
+  vulnerabilities->capacity = header->count + 1;
+  vulnerabilities->count = header->count;
+
+  for (size_t i = 0; i < header->count; i++)
+    {
+      vulnerability_t *vuln = &vulnerabilities->items[i];
+      vuln->analyzer = records[i].analyzer == SNAPSHOT_NULL ? "?" : strings + records[i].analyzer;
+      vuln->category = records[i].category == SNAPSHOT_NULL ? NULL : strings + records[i].category;
+      vuln->title = records[i].title == SNAPSHOT_NULL ? NULL : strings + records[i].title;
+      vuln->description = records[i].description == SNAPSHOT_NULL ? NULL : strings + records[i].description;
+      vuln->solution = records[i].solution == SNAPSHOT_NULL ? NULL : strings + records[i].solution;
+      vuln->file = records[i].file == SNAPSHOT_NULL ? NULL : strings + records[i].file;
+      vuln->line = records[i].line;
+      vuln->severity = records[i].severity;
+      vuln->confidence = records[i].confidence;
+    }
+
+  vulnerabilities->mappings = xgrow (vulnerabilities->mappings, sizeof (mapping_t), 1, &vulnerabilities->mappings_capacity);
+  vulnerabilities->mappings[0] = (mapping_t) { data, size };
+  vulnerabilities->mappings_count = 1;
+  data = MAP_FAILED;
+  err = 0;
+
+  cleanup:
+  if (data != MAP_FAILED) munmap (data, size);
+  if (fd >= 0) close (fd);
+  if (path) free (path);
+  if (directory) free (directory);
+  return err;
+}
+
+/*
+ * Find where `string` will be in snapshot strings, and move `offset`
+ * past it.
+ */
+static uint64_t
+place_string (const char *string, uint64_t *offset)
+{
+  if (!string)
+    return SNAPSHOT_NULL;
+
+  uint64_t placed = *offset;
+  *offset += strlen (string) + 1;
+  return placed;
+}
+
+/*
+ * Same as `place_string()` for analyzer of `vuln`, which is shared by
+ * all vulnerabilities of a report: it's only placed when it differs
+ * from the one of `previous`, the offset of which is `*last` then.
+ */
+static uint64_t
+place_analyzer (const vulnerability_t *vuln, const vulnerability_t *previous, uint64_t *last, uint64_t *offset)
+{
+  if (!previous || strcmp (vuln->analyzer, previous->analyzer) != 0)
+    *last = place_string (vuln->analyzer, offset);
+
+  return *last;
+}
+
+/*
+ * Write vulnerabilities of report at `uri` in a snapshot, so next
+ * time the report is opened, it does not have to be parsed again.
+ *
+ * The snapshot is written aside, then renamed, so a snapshot being
+ * written is never loaded. Snapshots are only a speedup, so failing to
+ * write one is not an error.
+ */
+void
+save_snapshot (const char *uri, const snapshot_key_t *key, vulnerability_list_t *vulnerabilities)
+{
+  char *directory = NULL;
+  char *path = NULL;
+  char *temporary = NULL;
+  FILE *output = NULL;
+  bool written = false;
+
+  directory = snapshot_directory ();
+  if (!directory || make_directories (directory))
+    goto cleanup;
+
+  path = snapshot_path (uri, directory);
+  if (!path)
+    goto cleanup;
+
+  temporary = xsprintf ("%s.XXXXXX", path);
+  int fd = mkstemp (temporary);
+  if (fd < 0)
+    {
+      free (temporary);
+      temporary = NULL;
+      goto cleanup;
+    }
+
+  output = fdopen (fd, "w");
+  if (!output)
+    {
+      close (fd);
+      goto cleanup;
+    }
+
+  snapshot_header_t header = { .key = *key, .count = vulnerabilities->count };
+  memcpy (header.magic, SNAPSHOT_MAGIC, sizeof (header.magic));
+
+  uint64_t offset = 0;
+  uint64_t analyzer = 0;
+  for (size_t i = 0; i < vulnerabilities->count; i++)
+    {
+      vulnerability_t *vuln = &vulnerabilities->items[i];
+      place_analyzer (vuln, i > 0 ? vuln - 1 : NULL, &analyzer, &offset);
+      place_string (vuln->category, &offset);
+      place_string (vuln->title, &offset);
+      place_string (vuln->description, &offset);
+      place_string (vuln->solution, &offset);
+      place_string (vuln->file, &offset);
+    }
+
+  // make sure strings are never empty, so they always end with a NUL.
+  header.strings_size = offset + 1;
+  fwrite (&header, sizeof (header), 1, output);
+
+  offset = 0;
+  for (size_t i = 0; i < vulnerabilities->count; i++)
+    {
+      vulnerability_t *vuln = &vulnerabilities->items[i];
+      snapshot_record_t record = {0};
+      record.analyzer = place_analyzer (vuln, i > 0 ? vuln - 1 : NULL, &analyzer, &offset);
+      record.category = place_string (vuln->category, &offset);
+      record.title = place_string (vuln->title, &offset);
+      record.description = place_string (vuln->description, &offset);
+      record.solution = place_string (vuln->solution, &offset);
+      record.file = place_string (vuln->file, &offset);
+      record.line = vuln->line;
+      record.severity = vuln->severity;
+      record.confidence = vuln->confidence;
+      fwrite (&record, sizeof (record), 1, output);
+    }
+
+  for (size_t i = 0; i < vulnerabilities->count; i++)
+    {
+      vulnerability_t *vuln = &vulnerabilities->items[i];
+      if (i == 0 || strcmp (vuln->analyzer, vuln[-1].analyzer) != 0)
+        fwrite (vuln->analyzer, strlen (vuln->analyzer) + 1, 1, output);
+
+      const char *strings[] = { vuln->category, vuln->title, vuln->description, vuln->solution, vuln->file };
+      for (size_t j = 0; j < sizeof (strings) / sizeof (*strings); j++)
+        if (strings[j])
+          fwrite (strings[j], strlen (strings[j]) + 1, 1, output);
+    }
+
+  fputc (0, output);
+  written = !ferror (output);
+
+  cleanup:
+  if (output && fclose (output)) written = false;
+  if (temporary)
+    {
+      if (!written || rename (temporary, path))
+        unlink (temporary);
+
+      free (temporary);
+    }
+
+  if (path) free (path);
+  if (directory) free (directory);
+}
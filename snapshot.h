@@ -0,0 +1,17 @@
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <stdint.h>
+
+typedef struct {
+  uint64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  uint64_t hash;
+} snapshot_key_t;
+
+int get_snapshot_key (const char *uri, snapshot_key_t *key);
+int load_snapshot (const char *uri, const snapshot_key_t *key, vulnerability_list_t *vulnerabilities);
+void save_snapshot (const char *uri, const snapshot_key_t *key, vulnerability_list_t *vulnerabilities);
+
+#endif
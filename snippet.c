@@ -0,0 +1,454 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "data.h"
+#include "source.h"
+#include "reflow.h"
+#include "snippet.h"
+#include "utils.h"
+
+/*
+ * Source of the snippet of a vulnerability, once it's been looked for.
+ */
+typedef struct {
+  bool loaded;
+  bool loading;
+  const source_t *source;
+} snippet_t;
+
+/*
+ * Layout of a neighbour of current vulnerability, made in advance.
+ * Until it's `ready`, a loader is working on it. A `stale` one is not
+ * wanted anymore, and is thrown away once ready.
+ */
+typedef struct {
+  bool used;
+  bool ready;
+  bool stale;
+  size_t index;
+  size_t max_width;
+  size_t size;
+  line_list_t lines;
+} prefetched_t;
+
+static vulnerability_list_t *loader_vulnerabilities = NULL;
+static snippet_t *snippets = NULL;
+
+/*
+ * Loaders first look for the snippet of `wanted`, the last
+ * vulnerability asked for, then lay out vulnerabilities in
+ * `prefetch_queue`, in order. Both are replaced as user moves, so
+ * work for vulnerabilities user already moved past is dropped before
+ * it starts.
+ */
+static pthread_t loaders[LOADER_THREADS];
+static size_t loaders_count = 0;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_changed = PTHREAD_COND_INITIALIZER;
+static bool stopping = false;
+static size_t wanted = SIZE_MAX;
+
+// bumped when source files change, so snippets found meanwhile are dropped.
+static unsigned long snippets_generation = 0;
+
+static size_t prefetch_queue[PREFETCH_DISTANCE * 2];
+static size_t prefetch_count = 0;
+static size_t prefetch_width = 0;
+
+// leave room for layouts still being made when the queue changes.
+static prefetched_t prefetched[PREFETCH_DISTANCE * 2 + LOADER_THREADS];
+static size_t prefetched_size = 0;
+static size_t prefetching = 0;
+
+static prefetched_t *
+find_prefetched (size_t index, size_t max_width)
+{
+  for (size_t i = 0; i < sizeof (prefetched) / sizeof (*prefetched); i++)
+    if (prefetched[i].used && !prefetched[i].stale && prefetched[i].index == index && prefetched[i].max_width == max_width)
+      return &prefetched[i];
+
+  return NULL;
+}
+
+static void
+release_prefetched (prefetched_t *slot)
+{
+  prefetched_size -= slot->size;
+  free_lines (&slot->lines);
+  memset (slot, 0, sizeof (*slot));
+}
+
+/*
+ * Find the next vulnerability to prefetch, and reserve a slot for it.
+ *
+ * One loader is always kept for `wanted`, so that slow prefetches
+ * don't delay the snippet user is waiting for.
+ *
+ * Returns NULL if there's nothing to do, or no room to do it.
+ */
+static prefetched_t *
+next_prefetch ()
+{
+  if (prefetching + 1 >= loaders_count)
+    return NULL;
+
+  for (size_t i = 0; i < prefetch_count; i++)
+    {
+      if (find_prefetched (prefetch_queue[i], prefetch_width))
+        continue;
+
+      for (size_t j = 0; j < sizeof (prefetched) / sizeof (*prefetched); j++)
+        if (!prefetched[j].used)
+          {
+            prefetched[j].used = true;
+            prefetched[j].index = prefetch_queue[i];
+            prefetched[j].max_width = prefetch_width;
+            return &prefetched[j];
+          }
+
+      return NULL;
+    }
+
+  return NULL;
+}
+
+/*
+ * Look for the snippet of vulnerability at `index`, unless it's known
+ * already. Lock must be held, it's released while looking.
+ */
+static const source_t *
+load_snippet (size_t index)
+{
+  if (snippets[index].loaded)
+    return snippets[index].source;
+
+  snippets[index].loading = true;
+  unsigned long generation = snippets_generation;
+
+  // this is the slow part, don't keep others waiting for the lock.
+  pthread_mutex_unlock (&lock);
+  const source_t *source = find_snippet_source (&loader_vulnerabilities->items[index]);
+  pthread_mutex_lock (&lock);
+
+  // a source which changed meanwhile may be freed, don't keep it.
+  snippets[index].loaded = generation == snippets_generation;
+  snippets[index].source = snippets[index].loaded ? source : NULL;
+  snippets[index].loading = false;
+  return source;
+}
+
+static void *
+run_loader (void *data)
+{
+  (void) data;
+
+  pthread_mutex_lock (&lock);
+
+  while (!stopping)
+    {
+      if (wanted != SIZE_MAX)
+        {
+          size_t index = wanted;
+          wanted = SIZE_MAX;
+
+          if (!snippets[index].loading)
+            load_snippet (index);
+
+          continue;
+        }
+
+      prefetched_t *slot = next_prefetch ();
+      if (!slot)
+        {
+          pthread_cond_wait (&work_changed, &lock);
+          continue;
+        }
+
+      size_t index = slot->index;
+      size_t max_width = slot->max_width;
+      prefetching++;
+      const source_t *source = load_snippet (index);
+
+      pthread_mutex_unlock (&lock);
+      line_list_t lines = {0};
+      reflow_with_snippet (max_width, &loader_vulnerabilities->items[index], source, false, &lines);
+      size_t size = lines.text_capacity + lines.capacity * sizeof (line_t);
+      pthread_mutex_lock (&lock);
+
+      slot->lines = lines;
+      slot->ready = true;
+      prefetching--;
+
+      // stay within budget, nearest neighbours are prefetched first.
+      if (slot->stale || prefetched_size + size > PREFETCH_BUDGET)
+        release_prefetched (slot);
+      else
+        {
+          slot->size = size;
+          prefetched_size += size;
+        }
+    }
+
+  pthread_mutex_unlock (&lock);
+  return NULL;
+}
+
+static void
+start_loaders ()
+{
+  wanted = SIZE_MAX;
+  stopping = false;
+
+  // loaders look at how many of them there are, let them start at once.
+  pthread_mutex_lock (&lock);
+  for (loaders_count = 0; loaders_count < LOADER_THREADS; loaders_count++)
+    if (pthread_create (&loaders[loaders_count], NULL, run_loader, NULL))
+      break;
+
+  pthread_mutex_unlock (&lock);
+}
+
+/*
+ * Stop loader threads, waiting for what they're working on, and throw
+ * away prefetched layouts.
+ */
+static void
+stop_loaders ()
+{
+  pthread_mutex_lock (&lock);
+  stopping = true;
+  pthread_cond_broadcast (&work_changed);
+  pthread_mutex_unlock (&lock);
+
+  for (size_t i = 0; i < loaders_count; i++)
+    pthread_join (loaders[i], NULL);
+
+  loaders_count = 0;
+  prefetch_count = 0;
+
+  for (size_t i = 0; i < sizeof (prefetched) / sizeof (*prefetched); i++)
+    if (prefetched[i].used)
+      release_prefetched (&prefetched[i]);
+}
+
+/*
+ * Start looking for snippets and preparing layouts on a small pool
+ * of background threads, so that slow filesystems don't freeze the
+ * interface.
+ *
+ * Vulnerabilities must not change until `stop_snippet_loader()` or
+ * `suspend_snippet_loader()` is called.
+ */
+void
+start_snippet_loader (vulnerability_list_t *vulnerabilities)
+{
+  loader_vulnerabilities = vulnerabilities;
+  snippets = xalloc ((vulnerabilities->count + 1) * sizeof (snippet_t));
+  start_loaders ();
+}
+
+/*
+ * Stop loader threads, keeping found snippets, so that vulnerabilities
+ * can be replaced.
+ */
+void
+suspend_snippet_loader ()
+{
+  stop_loaders ();
+}
+
+/*
+ * Start loader threads again once vulnerabilities were replaced.
+ *
+ * `kept[i]` is the index vulnerability `i` had before, if it did not
+ * change, or SIZE_MAX. Snippets of those are kept, others are looked
+ * for again. If `kept` is NULL, vulnerabilities did not change.
+ */
+void
+resume_snippet_loader (const size_t *kept)
+{
+  if (!kept)
+    {
+      start_loaders ();
+      return;
+    }
+
+  snippet_t *previous = snippets;
+  snippets = xalloc ((loader_vulnerabilities->count + 1) * sizeof (snippet_t));
+
+  for (size_t i = 0; i < loader_vulnerabilities->count; i++)
+    if (kept[i] != SIZE_MAX)
+      snippets[i] = previous[kept[i]];
+
+  free (previous);
+  start_loaders ();
+}
+
+/*
+ * Forget snippets and prefetched layouts of vulnerabilities in source
+ * file at `path`, because it changed.
+ */
+void
+forget_snippets (const char *path)
+{
+  pthread_mutex_lock (&lock);
+  snippets_generation++;
+
+  for (size_t i = 0; i < loader_vulnerabilities->count; i++)
+    {
+      const char *file = loader_vulnerabilities->items[i].file;
+      if (file && strcmp (file, path) == 0)
+        {
+          snippets[i].loaded = false;
+          snippets[i].source = NULL;
+        }
+    }
+
+  for (size_t i = 0; i < sizeof (prefetched) / sizeof (*prefetched); i++)
+    {
+      prefetched_t *slot = &prefetched[i];
+      if (!slot->used || slot->stale)
+        continue;
+
+      const char *file = loader_vulnerabilities->items[slot->index].file;
+      if (!file || strcmp (file, path) != 0)
+        continue;
+
+      if (slot->ready)
+        release_prefetched (slot);
+      else
+        slot->stale = true;
+    }
+
+  pthread_mutex_unlock (&lock);
+}
+
+/*
+ * Get the source of the snippet of vulnerability at `index` in `source`,
+ * which is NULL if there's no snippet to show.
+ *
+ * If it's not known yet, it's asked to loaders instead, replacing any
+ * previous request which didn't start yet, and `source` is left
+ * untouched. Without loader threads, it's looked for right away.
+ *
+ * Returns false if the snippet is still being looked for.
+ */
+bool
+get_snippet_source (size_t index, const source_t **source)
+{
+  if (loaders_count == 0)
+    {
+      if (!snippets[index].loaded)
+        {
+          snippets[index].source = find_snippet_source (&loader_vulnerabilities->items[index]);
+          snippets[index].loaded = true;
+        }
+
+      *source = snippets[index].source;
+      return true;
+    }
+
+  pthread_mutex_lock (&lock);
+
+  bool loaded = snippets[index].loaded;
+  if (loaded)
+    *source = snippets[index].source;
+  else if (!snippets[index].loading && wanted != index)
+    {
+      wanted = index;
+      pthread_cond_signal (&work_changed);
+    }
+
+  pthread_mutex_unlock (&lock);
+  return loaded;
+}
+
+/*
+ * Lay out vulnerabilities at `indexes` for `max_width` in background,
+ * in that order, so that moving to them does not wait.
+ *
+ * This replaces previous requests: layouts of vulnerabilities which
+ * are not in `indexes` are thrown away.
+ */
+void
+prefetch_layouts (const size_t *indexes, size_t count, size_t max_width)
+{
+  if (loaders_count == 0)
+    return;
+
+  if (count > PREFETCH_DISTANCE * 2)
+    count = PREFETCH_DISTANCE * 2;
+
+  pthread_mutex_lock (&lock);
+
+  memcpy (prefetch_queue, indexes, count * sizeof (*indexes));
+  prefetch_count = count;
+  prefetch_width = max_width;
+
+  for (size_t i = 0; i < sizeof (prefetched) / sizeof (*prefetched); i++)
+    {
+      prefetched_t *slot = &prefetched[i];
+      if (!slot->used || slot->stale)
+        continue;
+
+      bool kept = false;
+      for (size_t j = 0; j < count && !kept; j++)
+        kept = slot->index == indexes[j] && slot->max_width == max_width;
+
+      if (kept)
+        continue;
+
+      if (slot->ready)
+        release_prefetched (slot);
+      else
+        slot->stale = true;
+    }
+
+  pthread_cond_broadcast (&work_changed);
+  pthread_mutex_unlock (&lock);
+}
+
+/*
+ * Take the layout of vulnerability at `index` for `max_width` if it
+ * was prefetched, moving it to `lines`, which must be empty.
+ *
+ * Returns false if it's not ready.
+ */
+bool
+take_prefetched_layout (size_t index, size_t max_width, line_list_t *lines)
+{
+  if (loaders_count == 0)
+    return false;
+
+  pthread_mutex_lock (&lock);
+
+  prefetched_t *slot = find_prefetched (index, max_width);
+  bool ready = slot && slot->ready;
+  if (ready)
+    {
+      *lines = slot->lines;
+      memset (&slot->lines, 0, sizeof (slot->lines));
+      release_prefetched (slot);
+    }
+
+  pthread_mutex_unlock (&lock);
+  return ready;
+}
+
+/*
+ * Stop loader threads, waiting for what they're working on, and forget
+ * about found snippets and prefetched layouts.
+ */
+void
+stop_snippet_loader ()
+{
+  stop_loaders ();
+
+  if (snippets) free (snippets);
+  snippets = NULL;
+  loader_vulnerabilities = NULL;
+}
@@ -0,0 +1,17 @@
+#ifndef _SNIPPET_H_
+#define _SNIPPET_H_
+
+#define LOADER_THREADS 3
+#define PREFETCH_DISTANCE 3
+#define PREFETCH_BUDGET (8 * 1024 * 1024)
+
+void start_snippet_loader (vulnerability_list_t *vulnerabilities);
+bool get_snippet_source (size_t index, const source_t **source);
+void prefetch_layouts (const size_t *indexes, size_t count, size_t max_width);
+bool take_prefetched_layout (size_t index, size_t max_width, line_list_t *lines);
+void suspend_snippet_loader ();
+void resume_snippet_loader (const size_t *kept);
+void forget_snippets (const char *path);
+void stop_snippet_loader ();
+
+#endif
@@ -0,0 +1,286 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "data.h"
+#include "sort.h"
+#include "stats.h"
+#include "utils.h"
+
+#define RADIX_BITS 16
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+/*
+ * Orders of vulnerabilities, by sort key, as permutations of their
+ * indices: `orders[key][i]` is the index of the i-th vulnerability in
+ * that order, and `ranks[key]` is the inverse permutation.
+ *
+ * Vulnerabilities themselves never move. Each order is computed the
+ * first time it's used, then switching back to it costs nothing.
+ */
+static size_t *orders[SORT_KEYS_COUNT];
+static size_t *ranks[SORT_KEYS_COUNT];
+
+static const char *key_names[SORT_KEYS_COUNT] = {
+  [SORT_REPORT] = "report",
+  [SORT_SEVERITY] = "severity",
+  [SORT_FILE] = "file",
+  [SORT_CATEGORY] = "category",
+  [SORT_TITLE] = "title",
+};
+
+static int
+compare_strings (const void *a, const void *b)
+{
+  return strcmp (*(const char * const *) a, *(const char * const *) b);
+}
+
+static const char *
+key_string (const vulnerability_t *vuln, int key)
+{
+  switch (key)
+    {
+      case SORT_CATEGORY: return vuln->category;
+      case SORT_TITLE: return vuln->title;
+    }
+
+  return vuln->file;
+}
+
+/*
+ * Give each vulnerability the rank of its string for `key` among all
+ * distinct ones, in `values`, so that sorting compares integers rather
+ * than strings. Missing strings go last.
+ *
+ * Reports repeat the same few files, categories and titles, so only
+ * distinct strings are sorted: they're found with a hash table first.
+ *
+ * Returns the highest rank.
+ */
+static size_t
+rank_strings (const vulnerability_list_t *vulnerabilities, int key, size_t *values)
+{
+  size_t count = vulnerabilities->count;
+  size_t capacity = 64;
+  while (capacity < count * 2)
+    capacity *= 2;
+
+  // slots hold distinct string index + 1, so that 0 means empty.
+  size_t *table = xalloc (capacity * sizeof (size_t));
+  const char **strings = xalloc ((count + 1) * sizeof (char *));
+  size_t strings_count = 0;
+
+  for (size_t i = 0; i < count; i++)
+    {
+      const char *string = key_string (&vulnerabilities->items[i], key);
+      if (!string)
+        {
+          values[i] = SIZE_MAX;
+          continue;
+        }
+
+      size_t slot = hash_bytes (string, strlen (string)) & (capacity - 1);
+      while (table[slot] && strcmp (strings[table[slot] - 1], string) != 0)
+        slot = (slot + 1) & (capacity - 1);
+
+      if (!table[slot])
+        {
+          strings[strings_count] = string;
+          table[slot] = ++strings_count;
+        }
+
+      values[i] = table[slot] - 1;
+    }
+
+  // sorting moves strings around, remember where each one went.
+  size_t *moved = xalloc ((strings_count + 1) * sizeof (size_t));
+  const char **sorted = xalloc ((strings_count + 1) * sizeof (char *));
+  memcpy (sorted, strings, strings_count * sizeof (char *));
+  qsort (sorted, strings_count, sizeof (char *), compare_strings);
+
+  for (size_t i = 0; i < strings_count; i++)
+    {
+      size_t slot = hash_bytes (sorted[i], strlen (sorted[i])) & (capacity - 1);
+      while (strcmp (strings[table[slot] - 1], sorted[i]) != 0)
+        slot = (slot + 1) & (capacity - 1);
+
+      moved[table[slot] - 1] = i;
+    }
+
+  for (size_t i = 0; i < count; i++)
+    values[i] = values[i] == SIZE_MAX ? strings_count : moved[values[i]];
+
+  free (sorted);
+  free (moved);
+  free (strings);
+  free (table);
+  return strings_count;
+}
+
+/*
+ * Sort `order`, which holds `count` vulnerability indices, by
+ * `values[index]`, which are at most `max`. Vulnerabilities with equal
+ * values stay in the order they were.
+ *
+ * This is a least significant digit radix sort, with as many counting
+ * passes of RADIX_BITS as `max` needs, usually one or two.
+ */
+static void
+radix_sort (const size_t *values, size_t max, size_t *order, size_t count)
+{
+  size_t *buffer = xalloc ((count + 1) * sizeof (size_t));
+  size_t *counts = xalloc (RADIX_BUCKETS * sizeof (size_t));
+  size_t *src = order;
+  size_t *dst = buffer;
+
+  for (unsigned int shift = 0; shift < sizeof (size_t) * 8 && (shift == 0 || max >> shift); shift += RADIX_BITS)
+    {
+      memset (counts, 0, RADIX_BUCKETS * sizeof (size_t));
+      for (size_t i = 0; i < count; i++)
+        counts[(values[src[i]] >> shift) & (RADIX_BUCKETS - 1)]++;
+
+      size_t position = 0;
+      for (size_t digit = 0; digit < RADIX_BUCKETS; digit++)
+        {
+          size_t digit_count = counts[digit];
+          counts[digit] = position;
+          position += digit_count;
+        }
+
+      for (size_t i = 0; i < count; i++)
+        dst[counts[(values[src[i]] >> shift) & (RADIX_BUCKETS - 1)]++] = src[i];
+
+      size_t *swap = src;
+      src = dst;
+      dst = swap;
+    }
+
+  if (src != order)
+    memcpy (order, src, count * sizeof (size_t));
+
+  free (counts);
+  free (buffer);
+}
+
+/*
+ * Get the order of `vulnerabilities` by `key`, computing it the first
+ * time.
+ *
+ * The order by file is sorted by line, then by file. Other orders
+ * start from it and are sorted by their key, so that vulnerabilities
+ * with the same key stay in file and line order. Severity comes with
+ * confidence, both highest first.
+ *
+ * Returns NULL for SORT_REPORT, which keeps the order of the report.
+ */
+const size_t *
+sort_order (vulnerability_list_t *vulnerabilities, int key)
+{
+  if (key == SORT_REPORT || orders[key])
+    return orders[key];
+
+  size_t count = vulnerabilities->count;
+  const size_t *by_file = key == SORT_FILE ? NULL : sort_order (vulnerabilities, SORT_FILE);
+
+  uint64_t timer = start_timer ();
+  size_t *order = xalloc ((count + 1) * sizeof (size_t));
+  size_t *values = xalloc ((count + 1) * sizeof (size_t));
+  size_t max = 0;
+
+  if (key == SORT_FILE)
+    {
+      for (size_t i = 0; i < count; i++)
+        {
+          order[i] = i;
+          values[i] = vulnerabilities->items[i].line;
+          if (values[i] > max)
+            max = values[i];
+        }
+
+      radix_sort (values, max, order, count);
+    }
+  else
+    memcpy (order, by_file, count * sizeof (size_t));
+
+  if (key == SORT_SEVERITY)
+    {
+      for (size_t i = 0; i < count; i++)
+        values[i] = CONFIDENCES_COUNT - 1 - vulnerabilities->items[i].confidence;
+
+      radix_sort (values, CONFIDENCES_COUNT - 1, order, count);
+
+      for (size_t i = 0; i < count; i++)
+        values[i] = SEVERITIES_COUNT - 1 - vulnerabilities->items[i].severity;
+
+      radix_sort (values, SEVERITIES_COUNT - 1, order, count);
+    }
+  else
+    {
+      max = rank_strings (vulnerabilities, key, values);
+      radix_sort (values, max, order, count);
+    }
+
+  free (values);
+  stop_timer (STAGE_SORT, timer);
+
+  orders[key] = order;
+  return order;
+}
+
+/*
+ * Get the position of each vulnerability in the order by `key`, which
+ * is computed if needed.
+ *
+ * Returns NULL for SORT_REPORT, where positions are indices.
+ */
+const size_t *
+sort_ranks (vulnerability_list_t *vulnerabilities, int key)
+{
+  if (key == SORT_REPORT || ranks[key])
+    return ranks[key];
+
+  const size_t *order = sort_order (vulnerabilities, key);
+  ranks[key] = xalloc ((vulnerabilities->count + 1) * sizeof (size_t));
+  for (size_t i = 0; i < vulnerabilities->count; i++)
+    ranks[key][order[i]] = i;
+
+  return ranks[key];
+}
+
+/*
+ * Forget all orders, because vulnerabilities changed.
+ */
+void
+forget_sort_orders ()
+{
+  for (int key = 0; key < SORT_KEYS_COUNT; key++)
+    {
+      if (orders[key]) free (orders[key]);
+      if (ranks[key]) free (ranks[key]);
+      orders[key] = NULL;
+      ranks[key] = NULL;
+    }
+}
+
+/*
+ * Find the sort key called `name`.
+ *
+ * Returns -1 if there is none.
+ */
+int
+find_sort_key (const char *name)
+{
+  for (int key = 0; key < SORT_KEYS_COUNT; key++)
+    if (strcmp (key_names[key], name) == 0)
+      return key;
+
+  return -1;
+}
+
+const char *
+sort_key_name (int key)
+{
+  return key_names[key];
+}
@@ -0,0 +1,19 @@
+#ifndef _SORT_H_
+#define _SORT_H_
+
+enum {
+  SORT_REPORT,
+  SORT_SEVERITY,
+  SORT_FILE,
+  SORT_CATEGORY,
+  SORT_TITLE,
+  SORT_KEYS_COUNT,
+};
+
+const size_t *sort_order (vulnerability_list_t *vulnerabilities, int key);
+const size_t *sort_ranks (vulnerability_list_t *vulnerabilities, int key);
+void forget_sort_orders ();
+int find_sort_key (const char *name);
+const char *sort_key_name (int key);
+
+#endif
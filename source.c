@@ -0,0 +1,376 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "scan.h"
+#include "source.h"
+#include "stats.h"
+#include "utils.h"
+
+/*
+ * Source files referenced by vulnerabilities, by path as found in
+ * reports.
+ *
+ * This is an open addressing hash table, so that findings in the same
+ * file share the same content and line index.
+ *
+ * Each path is resolved once, when its file is loaded, and again only
+ * when it's invalidated.
+ *
+ * Sources may be asked for by several threads at once. Files are
+ * loaded without holding the lock, so that a slow file does not hold
+ * back others, and threads asking for a file being loaded wait for it.
+ *
+ * Outdated sources are replaced in the table, but other threads may
+ * still be reading them, so they're kept in `retired` until
+ * `free_retired_sources()`.
+ */
+static source_t **sources = NULL;
+static size_t sources_count = 0;
+static size_t sources_capacity = 0;
+static source_t **retired = NULL;
+static size_t retired_count = 0;
+static size_t retired_capacity = 0;
+static pthread_mutex_t sources_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t source_loaded = PTHREAD_COND_INITIALIZER;
+
+/*
+ * Root of the analyzed codebase, which relative paths of reports start
+ * from: `root` as given with --root, or NULL for current directory, and
+ * `real_root` its canonical path, resolved once at startup so that
+ * checking a source is inside it is a prefix comparison.
+ */
+static char *root = NULL;
+static char *real_root = NULL;
+static size_t real_root_len = 0;
+
+static const char *
+source_key (const void *item)
+{
+  const source_t *source = *(source_t * const *) item;
+  return source ? source->path : NULL;
+}
+
+/*
+ * Set the root of the analyzed codebase to `directory`, or to current
+ * directory if NULL.
+ *
+ * Returns non-zero if it can't be resolved.
+ */
+int
+set_source_root (const char *directory)
+{
+  char *real = realpath (directory ? directory : ".", NULL);
+  if (!real)
+    return 1;
+
+  if (root) free (root);
+  if (real_root) free (real_root);
+  root = directory ? strdup (directory) : NULL;
+  real_root = real;
+  real_root_len = strlen (real);
+  return 0;
+}
+
+/*
+ * Get the path of the first `len` bytes of `path`, which come from a
+ * report, relative to current directory rather than to the root.
+ *
+ * Returns an allocated string.
+ */
+char *
+join_source_root (const char *path, size_t len)
+{
+  if (!root || path[0] == '/')
+    return strndup (path, len);
+
+  size_t root_len = strlen (root);
+  const char *separator = root_len > 0 && root[root_len - 1] == '/' ? "" : "/";
+  return xsprintf ("%s%s%.*s", root, separator, (int) len, path);
+}
+
+/*
+ * Tell if canonical path `real` is the root or inside it. A mere
+ * common prefix is not enough: /src/app2 is not inside /src/app.
+ */
+static bool
+is_inside_root (const char *real)
+{
+  if (!real_root || strncmp (real, real_root, real_root_len) != 0)
+    return false;
+
+  return real[real_root_len] == '/' || real[real_root_len] == 0 || real_root[real_root_len - 1] == '/';
+}
+
+/*
+ * Resolve `source` path from the root, read the file in memory and
+ * index its lines.
+ *
+ * The file is copied rather than mapped: editors and checkouts may
+ * truncate it in place while we use it, and reading a mapping past the
+ * new end of file would crash. The copy stays what the file was.
+ *
+ * Files outside the root are not read at all, whatever reports point
+ * to. If the file can't be read, `readable` is left to false, so we
+ * don't try again next time.
+ */
+static void
+load_source (source_t *source)
+{
+  char *path = join_source_root (source->path, strlen (source->path));
+  char *real = realpath (path, NULL);
+  free (path);
+  if (!real || !is_inside_root (real))
+    {
+      if (real) free (real);
+      return;
+    }
+
+  int fd = open (real, O_RDONLY);
+  free (real);
+  if (fd < 0)
+    return;
+
+  struct stat info;
+  if (fstat (fd, &info) || !S_ISREG (info.st_mode))
+    {
+      close (fd);
+      return;
+    }
+
+  // the file may change size meanwhile, read until its actual end.
+  size_t capacity = info.st_size + 1;
+  char *data = xalloc (capacity);
+  size_t size = 0;
+
+  while (true)
+    {
+      data = xgrow (data, 1, size + 1, &capacity);
+      ssize_t count = read (fd, data + size, capacity - size);
+      if (count < 0 && errno == EINTR)
+        continue;
+
+      if (count < 0)
+        {
+          free (data);
+          close (fd);
+          return;
+        }
+
+      if (count == 0)
+        break;
+
+      size += count;
+    }
+
+  close (fd);
+  source->data = data;
+  source->size = size;
+  count_stat (COUNTER_BYTES_READ, source->size);
+
+  // line_starts[n] is where line n + 1 starts, and the extra last item
+  // is the end of file, so any line's boundaries are found in O(1).
+  size_t newlines = count_char (source->data, source->size, '\n');
+  source->line_starts = xalloc ((newlines + 2) * sizeof (size_t));
+  index_char (source->data, source->size, '\n', source->line_starts + 1);
+  for (size_t i = 1; i <= newlines; i++)
+    source->line_starts[i]++;
+
+  source->line_count = newlines;
+  if (source->line_starts[newlines] < source->size)
+    source->line_count++;
+
+  source->line_starts[source->line_count] = source->size;
+  source->readable = true;
+}
+
+/*
+ * Find the slot of `path` in the hash table, or the empty one where it
+ * would be. Lock must be held.
+ */
+static size_t
+find_source_slot (const char *path)
+{
+  size_t slot = hash_bytes (path, strlen (path)) & (sources_capacity - 1);
+  while (sources[slot] && strcmp (sources[slot]->path, path) != 0)
+    slot = (slot + 1) & (sources_capacity - 1);
+
+  return slot;
+}
+
+/*
+ * Get the source file at `path`, loading it if needed.
+ *
+ * This is thread safe.
+ *
+ * Returns NULL if the file can't be read, or is outside the root.
+ */
+const source_t *
+get_source (const char *path)
+{
+  if (!path)
+    return NULL;
+
+  pthread_mutex_lock (&sources_lock);
+
+  if ((sources_count + 1) * 2 > sources_capacity)
+    sources = grow_table (sources, sizeof (*sources), &sources_capacity, source_key);
+
+  size_t slot = find_source_slot (path);
+  source_t *source = sources[slot];
+  if (!source)
+    {
+      source = xalloc (sizeof (*source));
+      source->path = strdup (path);
+      sources[slot] = source;
+      sources_count++;
+    }
+  else if (source->loaded || source->loading)
+    {
+      while (!source->loaded)
+        pthread_cond_wait (&source_loaded, &sources_lock);
+
+      pthread_mutex_unlock (&sources_lock);
+      return source->readable ? source : NULL;
+    }
+
+  source->loading = true;
+  pthread_mutex_unlock (&sources_lock);
+
+  load_source (source);
+
+  pthread_mutex_lock (&sources_lock);
+  source->loaded = true;
+  pthread_cond_broadcast (&source_loaded);
+  pthread_mutex_unlock (&sources_lock);
+
+  return source->readable ? source : NULL;
+}
+
+/*
+ * Forget the source file at `path`, because it changed, so it's read
+ * again next time it's asked for.
+ *
+ * This is thread safe. Previous version stays valid for threads still
+ * using it.
+ *
+ * Returns false if the file was not loaded, so nothing came from it.
+ */
+bool
+invalidate_source (const char *path)
+{
+  pthread_mutex_lock (&sources_lock);
+
+  source_t *source = sources_capacity ? sources[find_source_slot (path)] : NULL;
+  bool outdated = source && source->loaded;
+  if (outdated)
+    {
+      retired = xgrow (retired, sizeof (*retired), retired_count + 1, &retired_capacity);
+      retired[retired_count++] = source;
+
+      source_t *replacement = xalloc (sizeof (*replacement));
+      replacement->path = strdup (path);
+      sources[find_source_slot (path)] = replacement;
+    }
+
+  pthread_mutex_unlock (&sources_lock);
+  return outdated;
+}
+
+/*
+ * Find line `number` (starting at 1) in `source`.
+ *
+ * `content` will point into the file content, it is not null terminated:
+ * use `len`, which excludes the line break.
+ *
+ * Returns false if there is no such line.
+ */
+bool
+get_source_line (const source_t *source, size_t number, const char **content, size_t *len)
+{
+  if (number == 0 || number > source->line_count)
+    return false;
+
+  size_t start = source->line_starts[number - 1];
+  size_t end = source->line_starts[number];
+  if (end > start && source->data[end - 1] == '\n')
+    end--;
+
+  *content = source->data + start;
+  *len = end - start;
+  return true;
+}
+
+static void
+free_source (source_t *source)
+{
+  if (source->data) free ((char *) source->data);
+  if (source->line_starts) free (source->line_starts);
+  free (source->path);
+  free (source);
+}
+
+/*
+ * Free outdated versions of source files, so that memory does not grow
+ * each time one is saved.
+ *
+ * No other thread may be using sources.
+ */
+void
+free_retired_sources ()
+{
+  pthread_mutex_lock (&sources_lock);
+
+  for (size_t i = 0; i < retired_count; i++)
+    free_source (retired[i]);
+
+  retired_count = 0;
+  pthread_mutex_unlock (&sources_lock);
+}
+
+/*
+ * Free all loaded source files. The root is kept, so they can be
+ * loaded again.
+ *
+ * No other thread may be using sources.
+ */
+void
+free_sources ()
+{
+  for (size_t i = 0; i < sources_capacity; i++)
+    if (sources[i])
+      free_source (sources[i]);
+
+  for (size_t i = 0; i < retired_count; i++)
+    free_source (retired[i]);
+
+  if (sources) free (sources);
+  if (retired) free (retired);
+  sources = NULL;
+  sources_count = 0;
+  sources_capacity = 0;
+  retired = NULL;
+  retired_count = 0;
+  retired_capacity = 0;
+}
+
+/*
+ * Forget the root set with `set_source_root()`. Sources can't be loaded
+ * until it is set again.
+ */
+void
+free_source_root ()
+{
+  if (root) free (root);
+  if (real_root) free (real_root);
+  root = NULL;
+  real_root = NULL;
+  real_root_len = 0;
+}
@@ -0,0 +1,27 @@
+#ifndef _SOURCE_H_
+#define _SOURCE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+  char *path;
+  const char *data;
+  size_t size;
+  size_t *line_starts;
+  size_t line_count;
+  bool readable;
+  bool loading;
+  bool loaded;
+} source_t;
+
+int set_source_root (const char *directory);
+char *join_source_root (const char *path, size_t len);
+const source_t *get_source (const char *path);
+bool invalidate_source (const char *path);
+bool get_source_line (const source_t *source, size_t number, const char **content, size_t *len);
+void free_retired_sources ();
+void free_sources ();
+void free_source_root ();
+
+#endif
@@ -0,0 +1,210 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "stats.h"
+
+/*
+ * Durations of a stage, in nanoseconds. `buckets[i]` counts durations
+ * under 2^i microseconds, and at least 2^(i-1) microseconds.
+ *
+ * Stages may be timed on several threads at once, so everything is
+ * updated atomically.
+ */
+typedef struct {
+  uint64_t count;
+  uint64_t total;
+  uint64_t max;
+  uint64_t last;
+  uint64_t buckets[STATS_BUCKETS];
+} stage_stats_t;
+
+bool stats_enabled = false;
+
+static stage_stats_t stages[STAGES_COUNT];
+static uint64_t counters[COUNTERS_COUNT];
+
+static const char *stage_names[STAGES_COUNT] = {
+  [STAGE_SNAPSHOT_KEY] = "snapshot key",
+  [STAGE_LOAD_SNAPSHOT] = "load snapshot",
+  [STAGE_READ_REPORT] = "read report",
+  [STAGE_VALIDATE] = "validate",
+  [STAGE_EXTRACT] = "extract",
+  [STAGE_SAVE_SNAPSHOT] = "save snapshot",
+  [STAGE_SORT] = "sort",
+  [STAGE_LAYOUT] = "layout",
+  [STAGE_REFLOW] = "reflow",
+  [STAGE_SNIPPET] = "snippet",
+  [STAGE_RENDER] = "render",
+};
+
+static const char *counter_names[COUNTERS_COUNT] = {
+  [COUNTER_ALLOCATIONS] = "allocations",
+  [COUNTER_BYTES_READ] = "bytes read",
+  [COUNTER_LINES] = "lines laid out",
+};
+
+static uint64_t
+now ()
+{
+  struct timespec time;
+  clock_gettime (CLOCK_MONOTONIC, &time);
+  return (uint64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+/*
+ * Start timing a stage.
+ *
+ * Returns 0 when stats are disabled, so this costs nothing more than
+ * a test.
+ */
+uint64_t
+start_timer ()
+{
+  return stats_enabled ? now () : 0;
+}
+
+/*
+ * Record the duration of `stage` since `start`, which was given by
+ * `start_timer()`.
+ */
+void
+stop_timer (int stage, uint64_t start)
+{
+  if (!start)
+    return;
+
+  uint64_t duration = now () - start;
+  stage_stats_t *stats = &stages[stage];
+
+  size_t bucket = 0;
+  for (uint64_t micros = duration / 1000; micros > 0 && bucket < STATS_BUCKETS - 1; micros >>= 1)
+    bucket++;
+
+  __atomic_add_fetch (&stats->count, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch (&stats->total, duration, __ATOMIC_RELAXED);
+  __atomic_add_fetch (&stats->buckets[bucket], 1, __ATOMIC_RELAXED);
+  __atomic_store_n (&stats->last, duration, __ATOMIC_RELAXED);
+
+  uint64_t max = __atomic_load_n (&stats->max, __ATOMIC_RELAXED);
+  while (duration > max && !__atomic_compare_exchange_n (&stats->max, &max, duration, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/*
+ * Add `amount` to `counter`, when stats are enabled.
+ */
+void
+count_stat (int counter, uint64_t amount)
+{
+  if (stats_enabled)
+    __atomic_add_fetch (&counters[counter], amount, __ATOMIC_RELAXED);
+}
+
+/*
+ * How long `stage` took the last time it ran, in nanoseconds.
+ */
+uint64_t
+last_duration (int stage)
+{
+  return __atomic_load_n (&stages[stage].last, __ATOMIC_RELAXED);
+}
+
+/*
+ * Write `duration` in a human readable way in `buffer`.
+ */
+void
+format_duration (uint64_t duration, char *buffer, size_t size)
+{
+  if (duration < 1000)
+    snprintf (buffer, size, "%luns", (unsigned long) duration);
+  else if (duration < 1000000)
+    snprintf (buffer, size, "%.1fus", duration / 1e3);
+  else if (duration < 1000000000)
+    snprintf (buffer, size, "%.1fms", duration / 1e6);
+  else
+    snprintf (buffer, size, "%.2fs", duration / 1e9);
+}
+
+/*
+ * Find under which duration `rank` of `stats` durations are, from
+ * their histogram, so it's only precise to a power of two.
+ */
+static uint64_t
+percentile (stage_stats_t *stats, double rank)
+{
+  uint64_t wanted = (uint64_t) (rank * stats->count + 0.5);
+  uint64_t seen = 0;
+
+  for (size_t i = 0; i < STATS_BUCKETS; i++)
+    {
+      seen += stats->buckets[i];
+      if (seen >= wanted && seen > 0)
+        {
+          uint64_t limit = (uint64_t) 1000 << i;
+          return limit < stats->max ? limit : stats->max;
+        }
+    }
+
+  return stats->max;
+}
+
+/*
+ * Write a summary of timings and counters to `output`, with a
+ * histogram of durations for each stage which ran.
+ */
+void
+print_stats (FILE *output)
+{
+  char total[32], mean[32], p50[32], p90[32], p99[32], max[32];
+
+  fprintf (output, "%-14s %8s %10s %10s %10s %10s %10s %10s\n", "stage", "count", "total", "mean", "p50", "p90", "p99", "max");
+
+  for (size_t i = 0; i < STAGES_COUNT; i++)
+    {
+      stage_stats_t *stats = &stages[i];
+      if (stats->count == 0)
+        continue;
+
+      format_duration (stats->total, total, sizeof (total));
+      format_duration (stats->total / stats->count, mean, sizeof (mean));
+      format_duration (percentile (stats, 0.5), p50, sizeof (p50));
+      format_duration (percentile (stats, 0.9), p90, sizeof (p90));
+      format_duration (percentile (stats, 0.99), p99, sizeof (p99));
+      format_duration (stats->max, max, sizeof (max));
+
+      fprintf (output, "%-14s %8lu %10s %10s %10s %10s %10s %10s\n", stage_names[i], (unsigned long) stats->count, total, mean, p50, p90, p99, max);
+    }
+
+  fprintf (output, "\n");
+  for (size_t i = 0; i < COUNTERS_COUNT; i++)
+    fprintf (output, "%-14s %8lu\n", counter_names[i], (unsigned long) counters[i]);
+
+  for (size_t i = 0; i < STAGES_COUNT; i++)
+    {
+      stage_stats_t *stats = &stages[i];
+      if (stats->count == 0)
+        continue;
+
+      uint64_t highest = 0;
+      for (size_t j = 0; j < STATS_BUCKETS; j++)
+        if (stats->buckets[j] > highest)
+          highest = stats->buckets[j];
+
+      fprintf (output, "\n%s:\n", stage_names[i]);
+      for (size_t j = 0; j < STATS_BUCKETS; j++)
+        {
+          if (stats->buckets[j] == 0)
+            continue;
+
+          char limit[32];
+          format_duration ((uint64_t) 1000 << j, limit, sizeof (limit));
+          fprintf (output, "  < %-8s %8lu ", limit, (unsigned long) stats->buckets[j]);
+
+          for (uint64_t k = 0; k < (stats->buckets[j] * 40 + highest - 1) / highest; k++)
+            fputc ('#', output);
+
+          fputc ('\n', output);
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+enum {
+  STAGE_SNAPSHOT_KEY,
+  STAGE_LOAD_SNAPSHOT,
+  STAGE_READ_REPORT,
+  STAGE_VALIDATE,
+  STAGE_EXTRACT,
+  STAGE_SAVE_SNAPSHOT,
+  STAGE_SORT,
+  STAGE_LAYOUT,
+  STAGE_REFLOW,
+  STAGE_SNIPPET,
+  STAGE_RENDER,
+  STAGES_COUNT,
+};
+
+enum {
+  COUNTER_ALLOCATIONS,
+  COUNTER_BYTES_READ,
+  COUNTER_LINES,
+  COUNTERS_COUNT,
+};
+
+#define STATS_BUCKETS 40
+
+extern bool stats_enabled;
+
+uint64_t start_timer ();
+void stop_timer (int stage, uint64_t start);
+void count_stat (int counter, uint64_t amount);
+uint64_t last_duration (int stage);
+void format_duration (uint64_t duration, char *buffer, size_t size);
+void print_stats (FILE *output);
+
+#endif
@@ -0,0 +1,782 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "decoder.h"
+#include "stream.h"
+#include "utils.h"
+
+/*
+ * Report a syntax error, with the position where it happened.
+ *
+ * Always returns non-zero, so it can be used as `return syntax_error ()`.
+ */
+static int
+syntax_error (stream_t *stream, const char *message)
+{
+  fprintf (stderr, "stream.c : malformed json at byte %ld : %s\n", stream_tell (stream), message);
+  return 1;
+}
+
+/*
+ * Read the next chunk of the file in buffer. For compressed files,
+ * buffer is the next chunk of decompressed data instead.
+ *
+ * Returns non-zero when there is nothing left to read. `failed` is set
+ * if that is because the file could not be read or decompressed.
+ */
+static int
+refill (stream_t *stream)
+{
+  if (stream->eof)
+    return 1;
+
+  stream->consumed += stream->length;
+  stream->position = 0;
+  stream->length = 0;
+
+  if (stream->decoder)
+    {
+      if (!decoder_read (stream->decoder, &stream->buffer, &stream->length))
+        {
+          stream->eof = true;
+          stream->failed = decoder_error (stream->decoder) != 0;
+          return 1;
+        }
+
+      return 0;
+    }
+
+  while (true)
+    {
+      ssize_t len = read (stream->fd, (char *) stream->buffer, STREAM_BUFFER_SIZE);
+      if (len < 0 && errno == EINTR)
+        continue;
+
+      if (len <= 0)
+        {
+          if (len < 0)
+            {
+              fprintf (stderr, "stream.c : refill() : can't read file : %s\n", strerror (errno));
+              stream->failed = true;
+            }
+
+          stream->eof = true;
+          return 1;
+        }
+
+      stream->length = len;
+      return 0;
+    }
+}
+
+static inline int
+peek_char (stream_t *stream)
+{
+  if (stream->position == stream->length && refill (stream))
+    return EOF;
+
+  return (unsigned char) stream->buffer[stream->position];
+}
+
+static inline int
+next_char (stream_t *stream)
+{
+  if (stream->position == stream->length && refill (stream))
+    return EOF;
+
+  return (unsigned char) stream->buffer[stream->position++];
+}
+
+/*
+ * Move past any whitespace, and return the next meaningful character
+ * without consuming it.
+ */
+static int
+skip_whitespace (stream_t *stream)
+{
+  while (true)
+    {
+      int c = peek_char (stream);
+      if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+        return c;
+
+      stream->position++;
+    }
+}
+
+/*
+ * Make sure the scratch buffer can receive `len` more bytes, plus the
+ * null terminator.
+ */
+static void
+reserve_scratch (stream_t *stream, size_t len)
+{
+  if (stream->scratch_length + len < stream->scratch_capacity)
+    return;
+
+  while (stream->scratch_length + len >= stream->scratch_capacity)
+    stream->scratch_capacity *= 2;
+
+  stream->scratch = realloc (stream->scratch, stream->scratch_capacity);
+  if (!stream->scratch)
+    {
+      fprintf (stderr, "stream.c : reserve_scratch() : can't allocate memory\n");
+      exit (1);
+    }
+}
+
+static void
+push_scratch (stream_t *stream, char c)
+{
+  reserve_scratch (stream, 1);
+  stream->scratch[stream->scratch_length++] = c;
+}
+
+static void
+push_codepoint (stream_t *stream, unsigned long codepoint)
+{
+  if (codepoint < 0x80)
+    push_scratch (stream, codepoint);
+  else if (codepoint < 0x800)
+    {
+      push_scratch (stream, 0xc0 | (codepoint >> 6));
+      push_scratch (stream, 0x80 | (codepoint & 0x3f));
+    }
+  else if (codepoint < 0x10000)
+    {
+      push_scratch (stream, 0xe0 | (codepoint >> 12));
+      push_scratch (stream, 0x80 | ((codepoint >> 6) & 0x3f));
+      push_scratch (stream, 0x80 | (codepoint & 0x3f));
+    }
+  else
+    {
+      push_scratch (stream, 0xf0 | (codepoint >> 18));
+      push_scratch (stream, 0x80 | ((codepoint >> 12) & 0x3f));
+      push_scratch (stream, 0x80 | ((codepoint >> 6) & 0x3f));
+      push_scratch (stream, 0x80 | (codepoint & 0x3f));
+    }
+}
+
+/*
+ * Read the four hexadecimal digits of a \u escape.
+ *
+ * Returns non-zero in case of error.
+ */
+static int
+read_hex (stream_t *stream, unsigned long *value)
+{
+  *value = 0;
+  for (int i = 0; i < 4; i++)
+    {
+      int c = next_char (stream);
+      *value <<= 4;
+      if (c >= '0' && c <= '9')
+        *value |= c - '0';
+      else if (c >= 'a' && c <= 'f')
+        *value |= c - 'a' + 10;
+      else if (c >= 'A' && c <= 'F')
+        *value |= c - 'A' + 10;
+      else
+        return syntax_error (stream, "invalid unicode escape");
+    }
+
+  return 0;
+}
+
+/*
+ * Decode the string at current position.
+ *
+ * If `keep` is true, its content is put in the scratch buffer,
+ * otherwise it's just skipped.
+ *
+ * Returns non-zero in case of error.
+ */
+static int
+scan_string (stream_t *stream, bool keep)
+{
+  stream->scratch_length = 0;
+  if (next_char (stream) != '"')
+    return syntax_error (stream, "expected a string");
+
+  while (true)
+    {
+      // fast path: copy everything up to the next quote or escape.
+      if (stream->position == stream->length && refill (stream))
+        return syntax_error (stream, "unterminated string");
+
+      const char *start = stream->buffer + stream->position;
+      size_t available = stream->length - stream->position;
+      size_t len = 0;
+      while (len < available && start[len] != '"' && start[len] != '\\' && (unsigned char) start[len] >= 0x20)
+        len++;
+
+      if (keep)
+        {
+          reserve_scratch (stream, len);
+          memcpy (stream->scratch + stream->scratch_length, start, len);
+          stream->scratch_length += len;
+        }
+
+      stream->position += len;
+      if (len == available)
+        continue;
+
+      int c = next_char (stream);
+      if (c == '"')
+        break;
+
+      if (c != '\\')
+        return syntax_error (stream, "control character in string");
+
+      c = next_char (stream);
+      switch (c)
+        {
+          case '"':  if (keep) push_scratch (stream, '"'); break;
+          case '\\': if (keep) push_scratch (stream, '\\'); break;
+          case '/':  if (keep) push_scratch (stream, '/'); break;
+          case 'b':  if (keep) push_scratch (stream, '\b'); break;
+          case 'f':  if (keep) push_scratch (stream, '\f'); break;
+          case 'n':  if (keep) push_scratch (stream, '\n'); break;
+          case 'r':  if (keep) push_scratch (stream, '\r'); break;
+          case 't':  if (keep) push_scratch (stream, '\t'); break;
+
+          case 'u':
+            {
+              unsigned long codepoint = 0;
+              if (read_hex (stream, &codepoint))
+                return 1;
+
+              if (codepoint >= 0xd800 && codepoint < 0xdc00)
+                {
+                  unsigned long low = 0;
+                  if (next_char (stream) != '\\' || next_char (stream) != 'u' || read_hex (stream, &low))
+                    return syntax_error (stream, "invalid surrogate pair");
+
+                  if (low < 0xdc00 || low >= 0xe000)
+                    return syntax_error (stream, "invalid surrogate pair");
+
+                  codepoint = 0x10000 + ((codepoint - 0xd800) << 10) + (low - 0xdc00);
+                }
+
+              if (keep)
+                push_codepoint (stream, codepoint);
+
+              break;
+            }
+
+          default:
+            return syntax_error (stream, "invalid escape sequence");
+        }
+    }
+
+  stream->scratch[stream->scratch_length] = 0;
+  return 0;
+}
+
+/*
+ * Read the number at current position into `buffer`.
+ *
+ * Returns non-zero in case of error.
+ */
+static int
+scan_number (stream_t *stream, char buffer[64], bool *is_integer)
+{
+  size_t len = 0;
+  *is_integer = true;
+
+  while (true)
+    {
+      int c = peek_char (stream);
+      if (!((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E'))
+        break;
+
+      if (c == '.' || c == 'e' || c == 'E')
+        *is_integer = false;
+
+      if (len == 63)
+        return syntax_error (stream, "number too long");
+
+      buffer[len++] = c;
+      stream->position++;
+    }
+
+  buffer[len] = 0;
+
+  char *end = NULL;
+  errno = 0;
+  strtod (buffer, &end);
+  if (len == 0 || *end != 0 || buffer[0] == '+')
+    return syntax_error (stream, "invalid number");
+
+  return 0;
+}
+
+/*
+ * Consume the literal `word` (true, false, null).
+ *
+ * Returns non-zero in case of error.
+ */
+static int
+scan_literal (stream_t *stream, const char *word)
+{
+  for (size_t i = 0; word[i]; i++)
+    if (next_char (stream) != word[i])
+      return syntax_error (stream, "invalid literal");
+
+  return 0;
+}
+
+static int next_member (stream_t *stream, bool *first, char *key, bool *done);
+
+static int
+skip_value (stream_t *stream, int depth)
+{
+  if (depth > STREAM_MAX_DEPTH)
+    return syntax_error (stream, "nesting too deep");
+
+  int err = 0;
+  bool first = true;
+  bool done = false;
+
+  switch (stream_peek_type (stream))
+    {
+      case STREAM_OBJECT:
+        while (true)
+          {
+            err = next_member (stream, &first, NULL, &done);
+            if (err || done)
+              return err;
+
+            err = skip_value (stream, depth + 1);
+            if (err)
+              return err;
+          }
+
+      case STREAM_ARRAY:
+        while (true)
+          {
+            err = stream_next_element (stream, &first, &done);
+            if (err || done)
+              return err;
+
+            err = skip_value (stream, depth + 1);
+            if (err)
+              return err;
+          }
+
+      case STREAM_STRING:
+        return scan_string (stream, false);
+
+      case STREAM_NUMBER:
+        {
+          char buffer[64] = {0};
+          bool is_integer = false;
+          return scan_number (stream, buffer, &is_integer);
+        }
+
+      case STREAM_BOOLEAN:
+        return scan_literal (stream, peek_char (stream) == 't' ? "true" : "false");
+
+      case STREAM_NULL:
+        return scan_literal (stream, "null");
+
+      default:
+        return syntax_error (stream, "expected a value");
+    }
+}
+
+/*
+ * Move to the next member of current object, copying its key in `key`
+ * unless it's NULL.
+ *
+ * Returns non-zero in case of error.
+ */
+static int
+next_member (stream_t *stream, bool *first, char *key, bool *done)
+{
+  *done = false;
+
+  if (*first)
+    {
+      *first = false;
+      if (skip_whitespace (stream) != '{')
+        return syntax_error (stream, "expected an object");
+
+      stream->position++;
+      if (skip_whitespace (stream) == '}')
+        {
+          stream->position++;
+          *done = true;
+          return 0;
+        }
+    }
+  else
+    {
+      // checked before moving on, so errors point at the culprit.
+      int c = skip_whitespace (stream);
+      if (c != ',' && c != '}')
+        return syntax_error (stream, "expected ',' or '}'");
+
+      stream->position++;
+      if (c == '}')
+        {
+          *done = true;
+          return 0;
+        }
+    }
+
+  skip_whitespace (stream);
+  int err = scan_string (stream, key != NULL);
+  if (err)
+    return err;
+
+  if (key)
+    {
+      if (stream->scratch_length < STREAM_MAX_KEY_LENGTH)
+        memcpy (key, stream->scratch, stream->scratch_length + 1);
+      else
+        key[0] = 0;
+    }
+
+  if (skip_whitespace (stream) != ':')
+    return syntax_error (stream, "expected ':'");
+
+  stream->position++;
+  return 0;
+}
+
+/*
+ * Read the first bytes of `stream`, and if they're compressed, start a
+ * decoder for it: the file is then decompressed on a separate thread
+ * while the stream parses what's already decompressed.
+ *
+ * Returns non-zero in case of error.
+ */
+static int
+detect_decoder (stream_t *stream)
+{
+  char *buffer = (char *) stream->buffer;
+
+  // pipes may give less than asked for.
+  while (stream->length < DECODER_MAGIC_LENGTH && !stream->eof)
+    {
+      ssize_t len = read (stream->fd, buffer + stream->length, STREAM_BUFFER_SIZE - stream->length);
+      if (len < 0 && errno == EINTR)
+        continue;
+
+      if (len <= 0)
+        {
+          if (len < 0)
+            fprintf (stderr, "stream.c : detect_decoder() : can't read file : %s\n", strerror (errno));
+
+          stream->eof = true;
+        }
+      else
+        stream->length += len;
+    }
+
+  int compression = detect_compression (buffer, stream->length);
+  if (compression == COMPRESSION_NONE)
+    return 0;
+
+  if (!is_compression_supported (compression))
+    {
+      fprintf (stderr, "stream.c : detect_decoder() : sasty was built without support for this compression.\n");
+      return 1;
+    }
+
+  stream->decoder = xalloc (sizeof (decoder_t));
+  if (start_decoder (stream->decoder, stream->fd, compression, buffer, stream->length))
+    {
+      free (stream->decoder);
+      stream->decoder = NULL;
+      return 1;
+    }
+
+  // buffer now comes from the decoder.
+  free (buffer);
+  stream->fd = -1;
+  stream->buffer = NULL;
+  stream->length = 0;
+  stream->eof = false;
+
+  return 0;
+}
+
+/*
+ * Open file at `uri` for streaming.
+ *
+ * The file is read by chunks of STREAM_BUFFER_SIZE bytes, so memory usage
+ * does not depend on the size of the file. Gzip and zstd files are
+ * decompressed on the fly. `uri` "-" is standard input.
+ *
+ * Returns non-zero in case of error.
+ */
+int
+stream_open (stream_t *stream, const char *uri)
+{
+  // standard input is duplicated, so that closing the stream leaves it open.
+  int fd = strcmp (uri, "-") == 0 ? dup (STDIN_FILENO) : open (uri, O_RDONLY);
+  if (fd < 0)
+    {
+      memset (stream, 0, sizeof (*stream));
+      stream->fd = -1;
+      fprintf (stderr, "stream.c : stream_open() : can't open file : %s\n", uri);
+      return 1;
+    }
+
+  return stream_open_fd (stream, fd);
+}
+
+/*
+ * Open file descriptor `fd` for streaming, like `stream_open()`. The
+ * stream owns `fd` from now on, and closes it.
+ *
+ * Returns non-zero in case of error.
+ */
+int
+stream_open_fd (stream_t *stream, int fd)
+{
+  memset (stream, 0, sizeof (*stream));
+  stream->fd = fd;
+
+  posix_fadvise (stream->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  stream->buffer = xalloc (STREAM_BUFFER_SIZE);
+  stream->scratch_capacity = 256;
+  stream->scratch = xalloc (stream->scratch_capacity);
+
+  return detect_decoder (stream);
+}
+
+/*
+ * Stream the `len` bytes at `data`, which must stay valid until the
+ * stream is closed.
+ *
+ * Unlike streams from `stream_open()`, those can be moved around with
+ * `stream_seek()`.
+ */
+void
+stream_open_memory (stream_t *stream, const char *data, size_t len)
+{
+  memset (stream, 0, sizeof (*stream));
+  stream->fd = -1;
+  stream->in_memory = true;
+  stream->buffer = data;
+  stream->length = len;
+  stream->eof = true;
+  stream->scratch_capacity = 256;
+  stream->scratch = xalloc (stream->scratch_capacity);
+}
+
+/*
+ * Release resources held by stream.
+ */
+void
+stream_close (stream_t *stream)
+{
+  if (stream->fd >= 0) close (stream->fd);
+  if (stream->decoder)
+    {
+      stop_decoder (stream->decoder);
+      free (stream->decoder);
+    }
+  else if (stream->buffer && !stream->in_memory)
+    free ((char *) stream->buffer);
+
+  if (stream->scratch) free (stream->scratch);
+  memset (stream, 0, sizeof (*stream));
+  stream->fd = -1;
+}
+
+/*
+ * Tell what kind of value comes next, without consuming it.
+ *
+ * Returns STREAM_NONE if the input ends or if the next character
+ * can't start a value.
+ */
+int
+stream_peek_type (stream_t *stream)
+{
+  switch (skip_whitespace (stream))
+    {
+      case '{': return STREAM_OBJECT;
+      case '[': return STREAM_ARRAY;
+      case '"': return STREAM_STRING;
+      case 't':
+      case 'f': return STREAM_BOOLEAN;
+      case 'n': return STREAM_NULL;
+      case '-':
+      case '0': case '1': case '2': case '3': case '4':
+      case '5': case '6': case '7': case '8': case '9':
+        return STREAM_NUMBER;
+      default: return STREAM_NONE;
+    }
+}
+
+/*
+ * Move to the next member of the object at current position.
+ *
+ * `first` must be true on the first call for a given object, it will
+ * be updated. Its key is copied to `key` (truncated keys are emptied,
+ * since they can't match anything we're looking for). When the object
+ * is over, `done` is set to true.
+ *
+ * The caller must then consume the value, either by reading it or
+ * with `stream_skip_value()`.
+ *
+ * Returns non-zero in case of error.
+ */
+int
+stream_next_member (stream_t *stream, bool *first, char key[STREAM_MAX_KEY_LENGTH], bool *done)
+{
+  return next_member (stream, first, key, done);
+}
+
+/*
+ * Move to the next element of the array at current position.
+ *
+ * Works like `stream_next_member()`, without the key.
+ *
+ * Returns non-zero in case of error.
+ */
+int
+stream_next_element (stream_t *stream, bool *first, bool *done)
+{
+  *done = false;
+
+  if (*first)
+    {
+      *first = false;
+      if (skip_whitespace (stream) != '[')
+        return syntax_error (stream, "expected an array");
+
+      stream->position++;
+      if (skip_whitespace (stream) == ']')
+        {
+          stream->position++;
+          *done = true;
+        }
+
+      return 0;
+    }
+
+  int c = skip_whitespace (stream);
+  if (c != ',' && c != ']')
+    return syntax_error (stream, "expected ',' or ']'");
+
+  stream->position++;
+  if (c == ']')
+    *done = true;
+
+  return 0;
+}
+
+/*
+ * Read the string at current position.
+ *
+ * `value` points to an internal buffer which is only valid until the
+ * next call on this stream, copy it if you need to keep it.
+ *
+ * Returns non-zero in case of error.
+ */
+int
+stream_read_string (stream_t *stream, const char **value, size_t *length)
+{
+  skip_whitespace (stream);
+  int err = scan_string (stream, true);
+  if (err)
+    return err;
+
+  *value = stream->scratch;
+  *length = stream->scratch_length;
+  return 0;
+}
+
+/*
+ * Read the number at current position.
+ *
+ * `is_integer` is set to false if the number is a valid json number
+ * but not an integer we can represent, in which case `value` is left
+ * untouched.
+ *
+ * Returns non-zero in case of error.
+ */
+int
+stream_read_integer (stream_t *stream, long long *value, bool *is_integer)
+{
+  char buffer[64] = {0};
+  skip_whitespace (stream);
+  int err = scan_number (stream, buffer, is_integer);
+  if (err)
+    return err;
+
+  if (*is_integer)
+    {
+      errno = 0;
+      long long number = strtoll (buffer, NULL, 10);
+      if (errno == ERANGE)
+        *is_integer = false;
+      else
+        *value = number;
+    }
+
+  return 0;
+}
+
+/*
+ * Consume whatever value is at current position, without keeping
+ * anything in memory.
+ *
+ * Returns non-zero in case of error.
+ */
+int
+stream_skip_value (stream_t *stream)
+{
+  return skip_value (stream, 0);
+}
+
+/*
+ * Make sure there is nothing left but whitespace in the stream, and
+ * that all of the file could be read.
+ *
+ * Returns non-zero in case of error.
+ */
+int
+stream_finish (stream_t *stream)
+{
+  if (skip_whitespace (stream) != EOF)
+    return syntax_error (stream, "unexpected content after json document");
+
+  // errors were already reported by `refill()` or the decoder.
+  if (stream->failed)
+    return 1;
+
+  return 0;
+}
+
+/*
+ * Tell how many bytes have been consumed so far.
+ */
+size_t
+stream_tell (stream_t *stream)
+{
+  return stream->consumed + stream->position;
+}
+
+/*
+ * Move to `offset`, as returned by `stream_tell()`.
+ *
+ * Only streams opened with `stream_open_memory()` can be moved.
+ */
+void
+stream_seek (stream_t *stream, size_t offset)
+{
+  if (stream->in_memory && offset <= stream->length)
+    stream->position = offset;
+}
@@ -0,0 +1,50 @@
+#ifndef _STREAM_H_
+#define _STREAM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define STREAM_BUFFER_SIZE 65536
+#define STREAM_MAX_KEY_LENGTH 64
+#define STREAM_MAX_DEPTH 512
+
+enum {
+  STREAM_NONE,
+  STREAM_OBJECT,
+  STREAM_ARRAY,
+  STREAM_STRING,
+  STREAM_NUMBER,
+  STREAM_BOOLEAN,
+  STREAM_NULL,
+};
+
+typedef struct {
+  int fd;
+  bool in_memory;
+  const char *buffer;
+  size_t length;
+  size_t position;
+  size_t consumed;
+  bool eof;
+  bool failed;
+  char *scratch;
+  size_t scratch_length;
+  size_t scratch_capacity;
+  struct decoder *decoder;
+} stream_t;
+
+int stream_open (stream_t *stream, const char *uri);
+int stream_open_fd (stream_t *stream, int fd);
+void stream_open_memory (stream_t *stream, const char *data, size_t len);
+void stream_close (stream_t *stream);
+int stream_peek_type (stream_t *stream);
+int stream_next_member (stream_t *stream, bool *first, char key[STREAM_MAX_KEY_LENGTH], bool *done);
+int stream_next_element (stream_t *stream, bool *first, bool *done);
+int stream_read_string (stream_t *stream, const char **value, size_t *length);
+int stream_read_integer (stream_t *stream, long long *value, bool *is_integer);
+int stream_skip_value (stream_t *stream);
+int stream_finish (stream_t *stream);
+size_t stream_tell (stream_t *stream);
+void stream_seek (stream_t *stream, size_t offset);
+
+#endif
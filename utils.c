@@ -1,5 +1,12 @@
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+#include "stats.h"
+#include "utils.h"
 
 /*
  * Safely allocates memory.
@@ -14,5 +21,119 @@ xalloc (size_t len)
       exit (1);
     }
 
+  count_stat (COUNTER_ALLOCATIONS, 1);
+  return mem;
+}
+
+/*
+ * Make sure `items` has room for `count` elements of `item_size` bytes.
+ *
+ * Capacity is doubled when it's not enough, so appending elements one
+ * by one stays linear overall. New elements are zeroed, like with
+ * `xalloc()`.
+ *
+ * Returns the (possibly moved) items.
+ */
+void *
+xgrow (void *items, size_t item_size, size_t count, size_t *capacity)
+{
+  if (count <= *capacity)
+    return items;
+
+  size_t new_capacity = *capacity ? *capacity : 16;
+  while (new_capacity < count)
+    new_capacity *= 2;
+
+  char *mem = realloc (items, new_capacity * item_size);
+  if (!mem)
+    {
+      fprintf (stderr, "xgrow() : can't allocated memory\n");
+      exit (1);
+    }
+
+  count_stat (COUNTER_ALLOCATIONS, 1);
+  memset (mem + *capacity * item_size, 0, (new_capacity - *capacity) * item_size);
+  *capacity = new_capacity;
   return mem;
 }
+
+/*
+ * Continue `hash` with the `len` bytes at `data`, so that several
+ * pieces can be hashed as one. Start from HASH_SEED.
+ *
+ * This is FNV-1a: it's fast on the short keys we hash, and good enough
+ * for hash tables and fingerprints.
+ */
+uint64_t
+extend_hash (uint64_t hash, const char *data, size_t len)
+{
+  for (size_t i = 0; i < len; i++)
+    {
+      hash ^= (unsigned char) data[i];
+      hash *= 1099511628211ULL;
+    }
+
+  return hash;
+}
+
+/*
+ * Hash the `len` bytes at `data`.
+ */
+uint64_t
+hash_bytes (const char *data, size_t len)
+{
+  return extend_hash (HASH_SEED, data, len);
+}
+
+/*
+ * Double the capacity of `table`, an open addressing hash table of
+ * `capacity` items of `item_size` bytes, with linear probing.
+ *
+ * `key` gives the string an item is hashed by, or NULL if its slot is
+ * empty, which must be the case of zeroed items.
+ *
+ * Returns the new table. The old one is freed.
+ */
+void *
+grow_table (void *table, size_t item_size, size_t *capacity, const char *(*key) (const void *item))
+{
+  size_t new_capacity = *capacity ? *capacity * 2 : 64;
+  char *items = table;
+  char *grown = xalloc (new_capacity * item_size);
+
+  for (size_t i = 0; i < *capacity; i++)
+    {
+      const char *item_key = key (items + i * item_size);
+      if (!item_key)
+        continue;
+
+      size_t slot = hash_bytes (item_key, strlen (item_key)) & (new_capacity - 1);
+      while (key (grown + slot * item_size))
+        slot = (slot + 1) & (new_capacity - 1);
+
+      memcpy (grown + slot * item_size, items + i * item_size, item_size);
+    }
+
+  if (table) free (table);
+  *capacity = new_capacity;
+  return grown;
+}
+
+/*
+ * Safely allocates a string formatted like with `printf()`.
+ */
+char *
+xsprintf (const char *format, ...)
+{
+  va_list args;
+  va_start (args, format);
+  int len = vsnprintf (NULL, 0, format, args);
+  va_end (args);
+
+  char *string = xalloc (len + 1);
+  va_start (args, format);
+  vsnprintf (string, len + 1, format, args);
+  va_end (args);
+
+  return string;
+}
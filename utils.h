@@ -1,6 +1,16 @@
 #ifndef _UTILS_H_
 #define _UTILS_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
+#define HASH_SEED 14695981039346656037ULL
+
 void *xalloc (size_t len);
+void *xgrow (void *items, size_t item_size, size_t count, size_t *capacity);
+uint64_t hash_bytes (const char *data, size_t len);
+uint64_t extend_hash (uint64_t hash, const char *data, size_t len);
+void *grow_table (void *table, size_t item_size, size_t *capacity, const char *(*key) (const void *item));
+char *xsprintf (const char *format, ...);
 
 #endif
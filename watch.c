@@ -0,0 +1,366 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "data.h"
+#include "loader.h"
+#include "source.h"
+#include "utils.h"
+#include "watch.h"
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE)
+
+/*
+ * A watched directory, by its path, which is empty for current
+ * directory, and the prefix of its files' paths in changes. They differ
+ * for source files when the root of the analyzed codebase is not
+ * current directory.
+ */
+typedef struct {
+  char *path;
+  char *prefix;
+  int wd;
+} directory_t;
+
+/*
+ * Directories are watched rather than files, so that files replaced by
+ * renaming a new version over them, as editors and analyzers often do,
+ * are still followed.
+ *
+ * `directories` is an open addressing hash table of paths, so that
+ * each directory costs a single inotify watch whatever the number of
+ * findings in it. `prefixes[wd]` is the prefix of directory watched as
+ * `wd`, to rebuild paths of files events are about.
+ */
+static int watch_fd = -1;
+static directory_t *directories = NULL;
+static size_t directories_count = 0;
+static size_t directories_capacity = 0;
+static const char **prefixes = NULL;
+static size_t prefixes_capacity = 0;
+
+/*
+ * Reports given on command line, by the directory they're in and their
+ * name, which is NULL for directories of reports.
+ */
+typedef struct {
+  int wd;
+  char *name;
+} watched_report_t;
+
+static watched_report_t *reports = NULL;
+static size_t reports_count = 0;
+static size_t reports_capacity = 0;
+
+// set once the system limit of inotify watches is reached.
+static bool watches_exhausted = false;
+
+static const char *
+directory_key (const void *item)
+{
+  return ((const directory_t *) item)->path;
+}
+
+/*
+ * Length of the directory part of `path`, including its last slash.
+ */
+static size_t
+prefix_length (const char *path)
+{
+  const char *slash = strrchr (path, '/');
+  return slash ? (size_t) (slash - path) + 1 : 0;
+}
+
+/*
+ * Watch the directory of `path`, whose first `len` bytes are the
+ * directory part, unless it's watched already. Changes in it are named
+ * from the first `prefix_len` bytes of `prefix`.
+ *
+ * Returns the watch descriptor, or -1 if the directory can't be
+ * watched.
+ */
+static int
+watch_directory (const char *path, size_t len, const char *prefix, size_t prefix_len)
+{
+  if ((directories_count + 1) * 2 > directories_capacity)
+    directories = grow_table (directories, sizeof (*directories), &directories_capacity, directory_key);
+
+  size_t slot = hash_bytes (path, len) & (directories_capacity - 1);
+  while (directories[slot].path)
+    {
+      directory_t *directory = &directories[slot];
+      if (strncmp (directory->path, path, len) == 0 && directory->path[len] == 0)
+        return directory->wd;
+
+      slot = (slot + 1) & (directories_capacity - 1);
+    }
+
+  char *directory_path = strndup (path, len);
+  int wd = inotify_add_watch (watch_fd, len > 0 ? directory_path : ".", WATCH_EVENTS);
+
+  // failures are remembered too, so we don't try again for each finding.
+  directories[slot] = (directory_t) { directory_path, strndup (prefix, prefix_len), wd };
+  directories_count++;
+
+  if (wd < 0 && errno == ENOSPC)
+    watches_exhausted = true;
+
+  // the same directory may be reached through different prefixes, the
+  // first one is used for its events.
+  if (wd >= 0 && (size_t) wd >= prefixes_capacity)
+    prefixes = xgrow (prefixes, sizeof (*prefixes), wd + 1, &prefixes_capacity);
+
+  if (wd >= 0 && !prefixes[wd])
+    prefixes[wd] = directories[slot].prefix;
+
+  return wd;
+}
+
+/*
+ * Start watching reports given on command line as `arguments`, which
+ * may be directories of reports, for changes.
+ *
+ * Returns non-zero in case of error.
+ */
+int
+start_watch (char **arguments, size_t count)
+{
+  watch_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+  if (watch_fd < 0)
+    {
+      fprintf (stderr, "watch.c : start_watch() : can't initialize inotify.\n");
+      return 1;
+    }
+
+  for (size_t i = 0; i < count; i++)
+    {
+      const char *argument = arguments[i];
+      watched_report_t report = { -1, NULL };
+      struct stat info;
+
+      if (stat (argument, &info) == 0 && S_ISDIR (info.st_mode))
+        {
+          size_t len = strlen (argument);
+          char *prefix = xsprintf ("%s%s", argument, len > 0 && argument[len - 1] == '/' ? "" : "/");
+          report.wd = watch_directory (prefix, strlen (prefix), prefix, strlen (prefix));
+          free (prefix);
+        }
+      else
+        {
+          size_t len = prefix_length (argument);
+          report.wd = watch_directory (argument, len, argument, len);
+          report.name = strdup (argument + len);
+        }
+
+      reports = xgrow (reports, sizeof (*reports), reports_count + 1, &reports_capacity);
+      reports[reports_count++] = report;
+
+      if (report.wd < 0)
+        {
+          fprintf (stderr, "watch.c : start_watch() : can't watch directory of %s.\n", argument);
+          stop_watch ();
+          return 1;
+        }
+    }
+
+  return 0;
+}
+
+/*
+ * Find which of the reports `event` is about.
+ *
+ * Returns NULL if it's about none of them.
+ */
+static const watched_report_t *
+find_report (const struct inotify_event *event)
+{
+  for (size_t i = 0; i < reports_count; i++)
+    {
+      if (reports[i].wd != event->wd)
+        continue;
+
+      if (reports[i].name ? strcmp (event->name, reports[i].name) == 0 : is_report_name (event->name))
+        return &reports[i];
+    }
+
+  return NULL;
+}
+
+/*
+ * Tell if watch mode is on.
+ */
+bool
+is_watching ()
+{
+  return watch_fd >= 0;
+}
+
+/*
+ * Watch directories of source files `vulnerabilities` refer to, so that
+ * snippets follow their changes. Directories watched already are
+ * skipped, so this can be called again for each version of the report.
+ *
+ * When the system limit of inotify watches is reached, remaining
+ * directories are not watched.
+ */
+void
+watch_sources (vulnerability_list_t *vulnerabilities)
+{
+  if (watch_fd < 0)
+    return;
+
+  const char *last = NULL;
+  size_t last_len = 0;
+
+  for (size_t i = 0; i < vulnerabilities->count && !watches_exhausted; i++)
+    {
+      const char *file = vulnerabilities->items[i].file;
+      if (!file)
+        continue;
+
+      // findings usually come file by file, skip the hash in that case.
+      size_t len = prefix_length (file);
+      if (last && len == last_len && strncmp (last, file, len) == 0)
+        continue;
+
+      last = file;
+      last_len = len;
+
+      // relative paths of reports start from the root.
+      char *path = join_source_root (file, len);
+      watch_directory (path, strlen (path), file, len);
+      free (path);
+    }
+}
+
+/*
+ * Add `path` to `changes`, unless it's there already.
+ */
+static void
+add_change (watch_changes_t *changes, const char *prefix, const char *name)
+{
+  char *path = xsprintf ("%s%s", prefix, name);
+
+  for (size_t i = 0; i < changes->count; i++)
+    if (strcmp (changes->paths[i], path) == 0)
+      {
+        free (path);
+        return;
+      }
+
+  changes->paths = xgrow (changes->paths, sizeof (char *), changes->count + 1, &changes->capacity);
+  changes->paths[changes->count++] = path;
+}
+
+/*
+ * Collect in `changes` what changed since last call, without waiting.
+ *
+ * Several writes to the same file only count once. If the kernel
+ * dropped events because we did not read them fast enough, the report
+ * is considered changed, so that at least the list is right.
+ *
+ * Returns true if anything changed.
+ */
+bool
+read_watch_changes (watch_changes_t *changes)
+{
+  char buffer[4096] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+  bool changed = false;
+
+  if (watch_fd < 0)
+    return false;
+
+  while (true)
+    {
+      ssize_t size = read (watch_fd, buffer, sizeof (buffer));
+      if (size <= 0)
+        break;
+
+      const struct inotify_event *event = NULL;
+      for (char *ptr = buffer; ptr < buffer + size; ptr += sizeof (struct inotify_event) + event->len)
+        {
+          event = (const struct inotify_event *) ptr;
+
+          if (event->mask & IN_Q_OVERFLOW)
+            {
+              changes->report_changed = changed = true;
+              continue;
+            }
+
+          if (event->len == 0 || event->wd < 0 || (size_t) event->wd >= prefixes_capacity || !prefixes[event->wd])
+            continue;
+
+          const watched_report_t *report = find_report (event);
+          if (report)
+            {
+              // a deleted report is most likely about to be written again,
+              // unless it was found in a directory.
+              if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO) || !report->name)
+                changes->report_changed = changed = true;
+
+              continue;
+            }
+
+          add_change (changes, prefixes[event->wd], event->name);
+          changed = true;
+        }
+    }
+
+  return changed;
+}
+
+/*
+ * Free memory held by `changes`, so it can be used again.
+ */
+void
+free_watch_changes (watch_changes_t *changes)
+{
+  for (size_t i = 0; i < changes->count; i++)
+    free (changes->paths[i]);
+
+  if (changes->paths) free (changes->paths);
+  memset (changes, 0, sizeof (*changes));
+}
+
+/*
+ * Stop watching, and free memory held by watches.
+ */
+void
+stop_watch ()
+{
+  if (watch_fd >= 0)
+    close (watch_fd);
+
+  for (size_t i = 0; i < directories_capacity; i++)
+    if (directories[i].path)
+      {
+        free (directories[i].path);
+        free (directories[i].prefix);
+      }
+
+  if (directories) free (directories);
+  if (prefixes) free (prefixes);
+  for (size_t i = 0; i < reports_count; i++)
+    if (reports[i].name)
+      free (reports[i].name);
+
+  if (reports) free (reports);
+
+  watch_fd = -1;
+  directories = NULL;
+  directories_count = 0;
+  directories_capacity = 0;
+  prefixes = NULL;
+  prefixes_capacity = 0;
+  reports = NULL;
+  reports_count = 0;
+  reports_capacity = 0;
+  watches_exhausted = false;
+}
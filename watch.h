@@ -0,0 +1,27 @@
+#ifndef _WATCH_H_
+#define _WATCH_H_
+
+/*
+ * How often we check for changes in watch mode, in milliseconds.
+ */
+#define WATCH_POLL_DELAY 250
+
+/*
+ * What changed since last check: whether reports were written again,
+ * and paths of other files which changed next to source files.
+ */
+typedef struct {
+  bool report_changed;
+  char **paths;
+  size_t count;
+  size_t capacity;
+} watch_changes_t;
+
+int start_watch (char **arguments, size_t count);
+bool is_watching ();
+void watch_sources (vulnerability_list_t *vulnerabilities);
+bool read_watch_changes (watch_changes_t *changes);
+void free_watch_changes (watch_changes_t *changes);
+void stop_watch ();
+
+#endif